@@ -0,0 +1,310 @@
+/*
+Pixel format scoring for win32_window.c.
+
+
+NOTES:
+- nothing in here includes windows.h or the WGL headers, so the scoring can be built and tested on any platform against attribute tables in the form wglGetPixelFormatAttribivARB() returns them, see tests/pixel_format_test.c.
+- the WGL_ARB_pixel_format attribute names and values are copied from the OpenGL registry (wglext.h) under our own names, they are fixed by the extension spec.
+*/
+#ifndef PIXEL_FORMAT_H
+#define PIXEL_FORMAT_H
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+
+/* @@ pixel format selection. Every pixel format the driver exposes is read into a Pixel_Format, and then scored against a Pixel_Format_Policy. Formats that miss a requirement are rejected, and the rest get a cost for everything they have beyond what was asked for (bits we don't need cost memory and bandwidth on every frame). The cheapest format wins. */
+#define PIXEL_FORMAT_WGL_DRAW_TO_WINDOW 0x2001 /* WGL_DRAW_TO_WINDOW_ARB */
+#define PIXEL_FORMAT_WGL_ACCELERATION 0x2003 /* WGL_ACCELERATION_ARB */
+#define PIXEL_FORMAT_WGL_SWAP_METHOD 0x2007 /* WGL_SWAP_METHOD_ARB */
+#define PIXEL_FORMAT_WGL_SUPPORT_OPENGL 0x2010 /* WGL_SUPPORT_OPENGL_ARB */
+#define PIXEL_FORMAT_WGL_DOUBLE_BUFFER 0x2011 /* WGL_DOUBLE_BUFFER_ARB */
+#define PIXEL_FORMAT_WGL_PIXEL_TYPE 0x2013 /* WGL_PIXEL_TYPE_ARB */
+#define PIXEL_FORMAT_WGL_COLOR_BITS 0x2014 /* WGL_COLOR_BITS_ARB */
+#define PIXEL_FORMAT_WGL_ALPHA_BITS 0x201B /* WGL_ALPHA_BITS_ARB */
+#define PIXEL_FORMAT_WGL_DEPTH_BITS 0x2022 /* WGL_DEPTH_BITS_ARB */
+#define PIXEL_FORMAT_WGL_STENCIL_BITS 0x2023 /* WGL_STENCIL_BITS_ARB */
+#define PIXEL_FORMAT_WGL_SAMPLES 0x2042 /* WGL_SAMPLES_ARB, needs WGL_ARB_multisample */
+#define PIXEL_FORMAT_WGL_FRAMEBUFFER_SRGB_CAPABLE 0x20A9 /* WGL_FRAMEBUFFER_SRGB_CAPABLE_ARB, needs WGL_ARB_framebuffer_sRGB or WGL_EXT_framebuffer_sRGB */
+
+#define PIXEL_FORMAT_WGL_NO_ACCELERATION 0x2025 /* WGL_NO_ACCELERATION_ARB */
+#define PIXEL_FORMAT_WGL_GENERIC_ACCELERATION 0x2026 /* WGL_GENERIC_ACCELERATION_ARB */
+#define PIXEL_FORMAT_WGL_FULL_ACCELERATION 0x2027 /* WGL_FULL_ACCELERATION_ARB */
+#define PIXEL_FORMAT_WGL_SWAP_EXCHANGE 0x2028 /* WGL_SWAP_EXCHANGE_ARB */
+#define PIXEL_FORMAT_WGL_SWAP_COPY 0x2029 /* WGL_SWAP_COPY_ARB */
+#define PIXEL_FORMAT_WGL_SWAP_UNDEFINED 0x202A /* WGL_SWAP_UNDEFINED_ARB */
+#define PIXEL_FORMAT_WGL_TYPE_RGBA 0x202B /* WGL_TYPE_RGBA_ARB */
+#define PIXEL_FORMAT_WGL_TYPE_COLORINDEX 0x202C /* WGL_TYPE_COLORINDEX_ARB */
+
+#define PIXEL_FORMAT_MAX_ATTRIBS 12
+
+enum {
+      PIXEL_FORMAT_ACCELERATION_NONE,
+      PIXEL_FORMAT_ACCELERATION_GENERIC,
+      PIXEL_FORMAT_ACCELERATION_FULL
+};
+
+enum {
+      PIXEL_FORMAT_SWAP_UNDEFINED,
+      PIXEL_FORMAT_SWAP_EXCHANGE,
+      PIXEL_FORMAT_SWAP_COPY
+};
+
+enum {
+      PIXEL_FORMAT_ACCEPTED,
+      PIXEL_FORMAT_REJECT_NOT_WINDOW,
+      PIXEL_FORMAT_REJECT_NO_OPENGL,
+      PIXEL_FORMAT_REJECT_SINGLE_BUFFERED,
+      PIXEL_FORMAT_REJECT_NOT_RGBA,
+      PIXEL_FORMAT_REJECT_ACCELERATION,
+      PIXEL_FORMAT_REJECT_COLOR_BITS,
+      PIXEL_FORMAT_REJECT_ALPHA_BITS,
+      PIXEL_FORMAT_REJECT_DEPTH_BITS,
+      PIXEL_FORMAT_REJECT_STENCIL_BITS,
+      PIXEL_FORMAT_REJECT_SAMPLES,
+      PIXEL_FORMAT_REJECT_SRGB,
+      PIXEL_FORMAT_REJECT_COUNT
+};
+
+/* costs, in "bits" of framebuffer. Depth and stencil bits count double since they are read and written by every depth tested fragment. */
+#define PIXEL_FORMAT_COST_COLOR_BIT 1
+#define PIXEL_FORMAT_COST_DEPTH_STENCIL_BIT 2
+#define PIXEL_FORMAT_COST_SAMPLE 32 /* per sample beyond what was asked for, each one multiplies the whole framebuffer */
+#define PIXEL_FORMAT_COST_NOT_FULL_ACCELERATION 4096
+#define PIXEL_FORMAT_COST_SWAP_UNDEFINED 8 /* the driver may flip or copy */
+#define PIXEL_FORMAT_COST_SWAP_COPY 64 /* a full framebuffer blit on every SwapBuffers() */
+#define PIXEL_FORMAT_COST_NO_SRGB 16
+
+typedef struct Pixel_Format {
+      int id; /* the index passed to SetPixelFormat() */
+      int draw_to_window;
+      int support_opengl;
+      int double_buffer;
+      int rgba;
+      int acceleration;
+      int swap_method;
+      int color_bits; /* excluding alpha */
+      int alpha_bits;
+      int depth_bits;
+      int stencil_bits;
+      int samples; /* '0' when the format isn't multisampled */
+      int srgb_capable;
+} Pixel_Format;
+
+typedef struct Pixel_Format_Policy {
+      int require_full_acceleration;
+      int min_color_bits;
+      int min_alpha_bits;
+      int min_depth_bits;
+      int min_stencil_bits;
+      int min_samples;
+      int max_samples;
+      int require_srgb;
+      int prefer_srgb; /* only costs, never rejects */
+      int prefer_swap_exchange;
+} Pixel_Format_Policy;
+/* @! */
+
+
+
+
+/* Writes the names of every attribute we score on into "attribs", in the order they're queried, and returns how many there are. Querying an attribute from an extension the driver doesn't have fails the whole wglGetPixelFormatAttribivARB() call, so the optional ones are only added when their extension is available.
+*/
+static int Pixel_Format_Query_Attribs(int attribs[PIXEL_FORMAT_MAX_ATTRIBS], int has_multisample, int has_framebuffer_srgb)
+{
+      int count = 0;
+      attribs[count++] = PIXEL_FORMAT_WGL_DRAW_TO_WINDOW;
+      attribs[count++] = PIXEL_FORMAT_WGL_SUPPORT_OPENGL;
+      attribs[count++] = PIXEL_FORMAT_WGL_DOUBLE_BUFFER;
+      attribs[count++] = PIXEL_FORMAT_WGL_PIXEL_TYPE;
+      attribs[count++] = PIXEL_FORMAT_WGL_ACCELERATION;
+      attribs[count++] = PIXEL_FORMAT_WGL_SWAP_METHOD;
+      attribs[count++] = PIXEL_FORMAT_WGL_COLOR_BITS;
+      attribs[count++] = PIXEL_FORMAT_WGL_ALPHA_BITS;
+      attribs[count++] = PIXEL_FORMAT_WGL_DEPTH_BITS;
+      attribs[count++] = PIXEL_FORMAT_WGL_STENCIL_BITS;
+      if(has_multisample) {
+            attribs[count++] = PIXEL_FORMAT_WGL_SAMPLES;
+      }
+      if(has_framebuffer_srgb) {
+            attribs[count++] = PIXEL_FORMAT_WGL_FRAMEBUFFER_SRGB_CAPABLE;
+      }
+
+
+      return count;
+}
+
+
+
+/* Fills in "format" from the values wglGetPixelFormatAttribivARB() returned for the attribute names in "attribs". Anything that wasn't queried stays 0, which is what a format without multisampling or sRGB reports anyway.
+*/
+static void Pixel_Format_Decode(int id, const int* attribs, const int* values, int attrib_count, Pixel_Format* format)
+{
+      memset(format, 0, sizeof(Pixel_Format));
+      format->id = id;
+      for(int i = 0; i < attrib_count; ++i) {
+            int value = values[i];
+            switch(attribs[i]) {
+            case PIXEL_FORMAT_WGL_DRAW_TO_WINDOW: { format->draw_to_window = value; } break;
+            case PIXEL_FORMAT_WGL_SUPPORT_OPENGL: { format->support_opengl = value; } break;
+            case PIXEL_FORMAT_WGL_DOUBLE_BUFFER: { format->double_buffer = value; } break;
+            case PIXEL_FORMAT_WGL_PIXEL_TYPE: { format->rgba = value == PIXEL_FORMAT_WGL_TYPE_RGBA; } break;
+            case PIXEL_FORMAT_WGL_ACCELERATION: {
+                  format->acceleration = value == PIXEL_FORMAT_WGL_FULL_ACCELERATION ? PIXEL_FORMAT_ACCELERATION_FULL :
+                        value == PIXEL_FORMAT_WGL_GENERIC_ACCELERATION ? PIXEL_FORMAT_ACCELERATION_GENERIC : PIXEL_FORMAT_ACCELERATION_NONE;
+            } break;
+            case PIXEL_FORMAT_WGL_SWAP_METHOD: {
+                  format->swap_method = value == PIXEL_FORMAT_WGL_SWAP_EXCHANGE ? PIXEL_FORMAT_SWAP_EXCHANGE :
+                        value == PIXEL_FORMAT_WGL_SWAP_COPY ? PIXEL_FORMAT_SWAP_COPY : PIXEL_FORMAT_SWAP_UNDEFINED;
+            } break;
+            case PIXEL_FORMAT_WGL_COLOR_BITS: { format->color_bits = value; } break;
+            case PIXEL_FORMAT_WGL_ALPHA_BITS: { format->alpha_bits = value; } break;
+            case PIXEL_FORMAT_WGL_DEPTH_BITS: { format->depth_bits = value; } break;
+            case PIXEL_FORMAT_WGL_STENCIL_BITS: { format->stencil_bits = value; } break;
+            case PIXEL_FORMAT_WGL_SAMPLES: { format->samples = value; } break;
+            case PIXEL_FORMAT_WGL_FRAMEBUFFER_SRGB_CAPABLE: { format->srgb_capable = value; } break;
+            default: {
+            } break;
+            }
+      }
+}
+
+
+
+static const char* Pixel_Format_Reject_Name(int reject)
+{
+      switch(reject) {
+      case PIXEL_FORMAT_ACCEPTED: return "accepted";
+      case PIXEL_FORMAT_REJECT_NOT_WINDOW: return "can't draw to a window";
+      case PIXEL_FORMAT_REJECT_NO_OPENGL: return "no OpenGL support";
+      case PIXEL_FORMAT_REJECT_SINGLE_BUFFERED: return "not double buffered";
+      case PIXEL_FORMAT_REJECT_NOT_RGBA: return "not RGBA";
+      case PIXEL_FORMAT_REJECT_ACCELERATION: return "not fully accelerated";
+      case PIXEL_FORMAT_REJECT_COLOR_BITS: return "too few color bits";
+      case PIXEL_FORMAT_REJECT_ALPHA_BITS: return "too few alpha bits";
+      case PIXEL_FORMAT_REJECT_DEPTH_BITS: return "too few depth bits";
+      case PIXEL_FORMAT_REJECT_STENCIL_BITS: return "too few stencil bits";
+      case PIXEL_FORMAT_REJECT_SAMPLES: return "sample count out of range";
+      case PIXEL_FORMAT_REJECT_SRGB: return "not sRGB capable";
+      }
+      return "unknown";
+}
+
+
+
+static void Pixel_Format_Add_Cost(int* cost, int amount, const char* what, char* reasons, size_t reasons_size)
+{
+      if(amount <= 0) {
+            return;
+      }
+      *cost += amount;
+
+      if(reasons != NULL) {
+            size_t length = strlen(reasons);
+            if(length < reasons_size) {
+                  snprintf(reasons + length, reasons_size - length, "%s%s +%d", length > 0 ? ", " : "", what, amount);
+            }
+      }
+}
+
+
+
+/* Scores one pixel format against the policy. Returns PIXEL_FORMAT_ACCEPTED and writes the format's cost to "cost", or returns the first requirement the format misses. If "reasons" isn't NULL, it gets a short description of what the cost is made of.
+*/
+static int Pixel_Format_Score(const Pixel_Format_Policy* policy, const Pixel_Format* format, int* cost, char* reasons, size_t reasons_size)
+{
+      *cost = 0;
+      if(reasons != NULL && reasons_size > 0) {
+            reasons[0] = '\0';
+      }
+
+      if(!format->draw_to_window) {
+            return PIXEL_FORMAT_REJECT_NOT_WINDOW;
+      }
+      if(!format->support_opengl) {
+            return PIXEL_FORMAT_REJECT_NO_OPENGL;
+      }
+      if(!format->double_buffer) {
+            return PIXEL_FORMAT_REJECT_SINGLE_BUFFERED;
+      }
+      if(!format->rgba) {
+            return PIXEL_FORMAT_REJECT_NOT_RGBA;
+      }
+      if(policy->require_full_acceleration && format->acceleration != PIXEL_FORMAT_ACCELERATION_FULL) {
+            return PIXEL_FORMAT_REJECT_ACCELERATION;
+      }
+      if(format->color_bits < policy->min_color_bits) {
+            return PIXEL_FORMAT_REJECT_COLOR_BITS;
+      }
+      if(format->alpha_bits < policy->min_alpha_bits) {
+            return PIXEL_FORMAT_REJECT_ALPHA_BITS;
+      }
+      if(format->depth_bits < policy->min_depth_bits) {
+            return PIXEL_FORMAT_REJECT_DEPTH_BITS;
+      }
+      if(format->stencil_bits < policy->min_stencil_bits) {
+            return PIXEL_FORMAT_REJECT_STENCIL_BITS;
+      }
+      if(format->samples < policy->min_samples || format->samples > policy->max_samples) {
+            return PIXEL_FORMAT_REJECT_SAMPLES;
+      }
+      if(policy->require_srgb && !format->srgb_capable) {
+            return PIXEL_FORMAT_REJECT_SRGB;
+      }
+
+      if(format->acceleration != PIXEL_FORMAT_ACCELERATION_FULL) {
+            Pixel_Format_Add_Cost(cost, PIXEL_FORMAT_COST_NOT_FULL_ACCELERATION, "not accelerated", reasons, reasons_size);
+      }
+      Pixel_Format_Add_Cost(cost, (format->color_bits - policy->min_color_bits) * PIXEL_FORMAT_COST_COLOR_BIT, "color bits", reasons, reasons_size);
+      Pixel_Format_Add_Cost(cost, (format->alpha_bits - policy->min_alpha_bits) * PIXEL_FORMAT_COST_COLOR_BIT, "alpha bits", reasons, reasons_size);
+      Pixel_Format_Add_Cost(cost, (format->depth_bits - policy->min_depth_bits) * PIXEL_FORMAT_COST_DEPTH_STENCIL_BIT, "depth bits", reasons, reasons_size);
+      Pixel_Format_Add_Cost(cost, (format->stencil_bits - policy->min_stencil_bits) * PIXEL_FORMAT_COST_DEPTH_STENCIL_BIT, "stencil bits", reasons, reasons_size);
+      Pixel_Format_Add_Cost(cost, (format->samples - policy->min_samples) * PIXEL_FORMAT_COST_SAMPLE, "samples", reasons, reasons_size);
+      if(policy->prefer_swap_exchange) {
+            if(format->swap_method == PIXEL_FORMAT_SWAP_COPY) {
+                  Pixel_Format_Add_Cost(cost, PIXEL_FORMAT_COST_SWAP_COPY, "swap copy", reasons, reasons_size);
+            } else if(format->swap_method == PIXEL_FORMAT_SWAP_UNDEFINED) {
+                  Pixel_Format_Add_Cost(cost, PIXEL_FORMAT_COST_SWAP_UNDEFINED, "swap undefined", reasons, reasons_size);
+            }
+      }
+      if(policy->prefer_srgb && !format->srgb_capable) {
+            Pixel_Format_Add_Cost(cost, PIXEL_FORMAT_COST_NO_SRGB, "no sRGB", reasons, reasons_size);
+      }
+      if(reasons != NULL && reasons_size > 0 && reasons[0] == '\0') {
+            snprintf(reasons, reasons_size, "exact match");
+      }
+
+
+      return PIXEL_FORMAT_ACCEPTED;
+}
+
+
+
+/* Returns the index (into "formats", not the pixel format id) of the cheapest format that meets the policy, or -1 if none do. Ties go to the earlier format, which keeps the driver's own order. "reject_counts" gets how many formats were rejected for each reason.
+*/
+static int Pixel_Format_Choose(const Pixel_Format_Policy* policy, const Pixel_Format* formats, int format_count, int reject_counts[PIXEL_FORMAT_REJECT_COUNT])
+{
+      memset(reject_counts, 0, sizeof(int) * PIXEL_FORMAT_REJECT_COUNT);
+
+      int best_index = -1;
+      int best_cost = 0;
+      for(int i = 0; i < format_count; ++i) {
+            int cost;
+            int result = Pixel_Format_Score(policy, &formats[i], &cost, NULL, 0);
+            reject_counts[result] += 1;
+            if(result != PIXEL_FORMAT_ACCEPTED) {
+                  continue;
+            }
+            if(best_index < 0 || cost < best_cost) {
+                  best_index = i;
+                  best_cost = cost;
+            }
+      }
+
+
+      return best_index;
+}
+
+#endif
@@ -0,0 +1,240 @@
+/*
+Table driven tests for the pixel format scoring in pixel_format.h.
+
+
+NOTES:
+- this doesn't need Windows, build and run it with any C99 compiler from the repository root:
+      cc -std=c99 -Wall -o pixel_format_test tests/pixel_format_test.c && ./pixel_format_test
+      cl tests\pixel_format_test.c && pixel_format_test.exe
+- every table holds the raw values wglGetPixelFormatAttribivARB() returns, one row per format, in the order Pixel_Format_Query_Attribs() asks for them. The rows go through Pixel_Format_Decode() just like in win32_window.c.
+- to add a table for another driver, build win32_window.c with /DLOG_COMPILE_LEVEL=0 and copy the "pixel format attribs:" lines it logs at startup. The rows are always 13 values wide, the trailing ones are 0 when the driver lacks WGL_ARB_multisample or WGL_ARB_framebuffer_sRGB.
+- the exit code is 1 if any test failed.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "../pixel_format.h"
+
+
+
+
+/* @@ attribute tables. Column order: id, draw to window, support OpenGL, double buffer, pixel type, acceleration, swap method, color bits, alpha bits, depth bits, stencil bits, then samples and sRGB capable when the driver has the extensions. */
+#define RGBA PIXEL_FORMAT_WGL_TYPE_RGBA
+#define INDEX PIXEL_FORMAT_WGL_TYPE_COLORINDEX
+#define FULL PIXEL_FORMAT_WGL_FULL_ACCELERATION
+#define GENERIC PIXEL_FORMAT_WGL_GENERIC_ACCELERATION
+#define NO_ACCEL PIXEL_FORMAT_WGL_NO_ACCELERATION
+#define EXCHANGE PIXEL_FORMAT_WGL_SWAP_EXCHANGE
+#define COPY PIXEL_FORMAT_WGL_SWAP_COPY
+#define UNDEFINED PIXEL_FORMAT_WGL_SWAP_UNDEFINED
+
+#define TABLE_COLUMNS (1 + PIXEL_FORMAT_MAX_ATTRIBS)
+
+typedef struct Format_Table {
+      const char* name;
+      int has_multisample;
+      int has_framebuffer_srgb;
+      int row_count;
+      const int (*rows)[TABLE_COLUMNS];
+} Format_Table;
+
+/* a desktop driver with both extensions, in the layout of a typical list: the usual depth/stencil combinations first, then the multisampled variants, then formats a window can't use */
+static const int discrete_gpu_rows[][TABLE_COLUMNS] = {
+      { 1, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 24, 8, 0, 1 },
+      { 2, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 24, 0, 0, 1 },
+      { 3, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 0, 0, 0, 1 },
+      { 4, 1, 1, 1, RGBA, FULL, COPY, 24, 8, 0, 0, 0, 1 },
+      { 5, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 24, 8, 4, 1 },
+      { 6, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 0, 0, 4, 1 },
+      { 7, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 24, 8, 8, 1 },
+      { 8, 1, 1, 0, RGBA, FULL, UNDEFINED, 24, 8, 0, 0, 0, 1 },
+      { 9, 1, 1, 1, RGBA, FULL, EXCHANGE, 30, 2, 0, 0, 0, 0 },
+      { 10, 0, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 24, 8, 0, 1 },
+      { 11, 1, 1, 1, RGBA, FULL, EXCHANGE, 24, 8, 0, 0, 0, 0 },
+      { 12, 1, 0, 1, RGBA, FULL, EXCHANGE, 24, 8, 0, 0, 0, 0 },
+      { 13, 1, 1, 1, RGBA, NO_ACCEL, COPY, 24, 8, 32, 8, 0, 0 },
+      { 14, 1, 1, 1, INDEX, FULL, EXCHANGE, 8, 0, 0, 0, 0, 0 },
+};
+
+/* a driver that only lists formats with undefined swaps and without sRGB, and has no WGL_ARB_framebuffer_sRGB, so the last column is unused */
+static const int undefined_swap_rows[][TABLE_COLUMNS] = {
+      { 1, 1, 1, 1, RGBA, FULL, UNDEFINED, 24, 8, 24, 8, 0, 0 },
+      { 2, 1, 1, 1, RGBA, FULL, UNDEFINED, 24, 8, 16, 0, 0, 0 },
+      { 3, 1, 1, 1, RGBA, FULL, UNDEFINED, 24, 8, 24, 8, 4, 0 },
+};
+
+/* the software GDI implementation, without either extension: nothing is fully accelerated */
+static const int gdi_generic_rows[][TABLE_COLUMNS] = {
+      { 1, 1, 1, 1, RGBA, GENERIC, COPY, 32, 8, 32, 8, 0, 0 },
+      { 2, 1, 1, 1, RGBA, GENERIC, COPY, 24, 8, 16, 0, 0, 0 },
+      { 3, 1, 1, 0, RGBA, NO_ACCEL, UNDEFINED, 24, 8, 16, 0, 0, 0 },
+};
+
+#define TABLE(rows, has_multisample, has_framebuffer_srgb) { #rows, has_multisample, has_framebuffer_srgb, (int)(sizeof(rows) / sizeof(rows[0])), rows }
+static const Format_Table discrete_gpu = TABLE(discrete_gpu_rows, 1, 1);
+static const Format_Table undefined_swap = TABLE(undefined_swap_rows, 1, 0);
+static const Format_Table gdi_generic = TABLE(gdi_generic_rows, 0, 0);
+/* @! */
+
+
+
+
+/* @@ test cases. Each case picks a table, describes a policy, and says which format id has to win (0 for none), and optionally what the winner's cost is made of and how many formats a reason has to reject. */
+typedef struct Test_Case {
+      const char* name;
+      const Format_Table* table;
+      int msaa_samples;
+      int depth_bits;
+      int stencil_bits;
+      int srgb;
+      int require_full_acceleration;
+      int expected_id;
+      const char* expected_reasons; /* NULL to skip the check */
+      int expected_reject; /* a PIXEL_FORMAT_REJECT_* to count, PIXEL_FORMAT_ACCEPTED to skip the check */
+      int expected_reject_count;
+} Test_Case;
+
+static const Test_Case test_cases[] = {
+      { "default policy takes no depth or stencil", &discrete_gpu, 0, 0, 0, 0, 1, 3, "exact match", PIXEL_FORMAT_ACCEPTED, 0 },
+      { "asking for depth and stencil takes them", &discrete_gpu, 0, 24, 8, 0, 1, 1, "exact match", PIXEL_FORMAT_ACCEPTED, 0 },
+      { "depth only doesn't pay for stencil", &discrete_gpu, 0, 24, 0, 0, 1, 2, "exact match", PIXEL_FORMAT_ACCEPTED, 0 },
+      { "exact sample count", &discrete_gpu, 4, 0, 0, 0, 1, 6, NULL, PIXEL_FORMAT_REJECT_SAMPLES, 6 },
+      { "sample count nobody has", &discrete_gpu, 16, 0, 0, 0, 1, 0, NULL, PIXEL_FORMAT_REJECT_SAMPLES, 8 },
+      { "sRGB required", &discrete_gpu, 0, 0, 0, 1, 1, 3, "exact match", PIXEL_FORMAT_REJECT_SRGB, 1 },
+      { "single buffered and index formats are rejected", &discrete_gpu, 0, 0, 0, 0, 1, 3, NULL, PIXEL_FORMAT_REJECT_SINGLE_BUFFERED, 1 },
+      { "10 bit color misses the alpha minimum", &discrete_gpu, 0, 0, 0, 0, 1, 3, NULL, PIXEL_FORMAT_REJECT_ALPHA_BITS, 1 },
+      { "cheapest of the undefined swap formats", &undefined_swap, 0, 0, 0, 0, 1, 2, "depth bits +32, swap undefined +8", PIXEL_FORMAT_ACCEPTED, 0 },
+      { "sRGB required without the extension", &undefined_swap, 0, 0, 0, 1, 1, 0, NULL, PIXEL_FORMAT_REJECT_SRGB, 2 },
+      { "generic only with full acceleration required", &gdi_generic, 0, 0, 0, 0, 1, 0, NULL, PIXEL_FORMAT_REJECT_ACCELERATION, 2 },
+      { "generic only as a fallback", &gdi_generic, 0, 0, 0, 0, 0, 2, "not accelerated +4096, depth bits +32, swap copy +64", PIXEL_FORMAT_ACCEPTED, 0 },
+};
+/* @! */
+
+
+
+
+static int Test_Decode_Table(const Format_Table* table, Pixel_Format* formats)
+{
+      int attribs[PIXEL_FORMAT_MAX_ATTRIBS];
+      int attrib_count = Pixel_Format_Query_Attribs(attribs, table->has_multisample, table->has_framebuffer_srgb);
+      for(int i = 0; i < table->row_count; ++i) {
+            const int* row = table->rows[i];
+            Pixel_Format_Decode(row[0], attribs, row + 1, attrib_count, &formats[i]);
+      }
+
+
+      return table->row_count;
+}
+
+
+
+/* Checks that the WGL values map onto the right Pixel_Format fields, and that attributes the driver wasn't asked for stay 0. */
+static int Test_Decode(void)
+{
+      int failure_count = 0;
+      Pixel_Format formats[32];
+
+      Test_Decode_Table(&discrete_gpu, formats);
+      const Pixel_Format* f = &formats[4];
+      if(f->id != 5 || !f->draw_to_window || !f->support_opengl || !f->double_buffer || !f->rgba ||
+         f->acceleration != PIXEL_FORMAT_ACCELERATION_FULL || f->swap_method != PIXEL_FORMAT_SWAP_EXCHANGE ||
+         f->color_bits != 24 || f->alpha_bits != 8 || f->depth_bits != 24 || f->stencil_bits != 8 || f->samples != 4 || f->srgb_capable != 1) {
+            printf("FAIL: decode: discrete_gpu format 5 decoded wrong\n");
+            failure_count += 1;
+      }
+      if(formats[13].rgba != 0 || formats[12].acceleration != PIXEL_FORMAT_ACCELERATION_NONE || formats[3].swap_method != PIXEL_FORMAT_SWAP_COPY) {
+            printf("FAIL: decode: discrete_gpu pixel type, acceleration or swap method decoded wrong\n");
+            failure_count += 1;
+      }
+
+      Test_Decode_Table(&gdi_generic, formats);
+      if(formats[0].acceleration != PIXEL_FORMAT_ACCELERATION_GENERIC || formats[0].samples != 0 || formats[0].srgb_capable != 0) {
+            printf("FAIL: decode: gdi_generic format 1 decoded wrong\n");
+            failure_count += 1;
+      }
+
+      /* a failed query leaves the values zeroed, which must never be chosen */
+      int attribs[PIXEL_FORMAT_MAX_ATTRIBS];
+      int zeros[PIXEL_FORMAT_MAX_ATTRIBS] = {0};
+      int attrib_count = Pixel_Format_Query_Attribs(attribs, 1, 1);
+      Pixel_Format_Decode(1, attribs, zeros, attrib_count, &formats[0]);
+      Pixel_Format_Policy policy;
+      memset(&policy, 0, sizeof(Pixel_Format_Policy));
+      int cost;
+      if(Pixel_Format_Score(&policy, &formats[0], &cost, NULL, 0) != PIXEL_FORMAT_REJECT_NOT_WINDOW) {
+            printf("FAIL: decode: a zeroed format wasn't rejected as not drawable to a window\n");
+            failure_count += 1;
+      }
+
+
+      return failure_count;
+}
+
+
+
+/* Runs one case with the same policy main() builds from its user variables. */
+static int Test_Run_Case(const Test_Case* test)
+{
+      Pixel_Format formats[32];
+      int format_count = Test_Decode_Table(test->table, formats);
+
+      Pixel_Format_Policy policy;
+      memset(&policy, 0, sizeof(Pixel_Format_Policy));
+      policy.require_full_acceleration = test->require_full_acceleration;
+      policy.min_color_bits = 24;
+      policy.min_alpha_bits = 8;
+      policy.min_depth_bits = test->depth_bits;
+      policy.min_stencil_bits = test->stencil_bits;
+      policy.min_samples = test->msaa_samples;
+      policy.max_samples = test->msaa_samples;
+      policy.require_srgb = test->srgb;
+      policy.prefer_srgb = test->srgb;
+      policy.prefer_swap_exchange = 1;
+
+      int reject_counts[PIXEL_FORMAT_REJECT_COUNT];
+      int chosen_index = Pixel_Format_Choose(&policy, formats, format_count, reject_counts);
+      int chosen_id = chosen_index >= 0 ? formats[chosen_index].id : 0;
+      if(chosen_id != test->expected_id) {
+            printf("FAIL: %s (%s): chose format %d, expected %d\n", test->name, test->table->name, chosen_id, test->expected_id);
+            return 1;
+      }
+
+      if(test->expected_reasons != NULL && chosen_index >= 0) {
+            int cost;
+            char reasons[192];
+            Pixel_Format_Score(&policy, &formats[chosen_index], &cost, reasons, sizeof(reasons));
+            if(strcmp(reasons, test->expected_reasons) != 0) {
+                  printf("FAIL: %s (%s): cost was \"%s\", expected \"%s\"\n", test->name, test->table->name, reasons, test->expected_reasons);
+                  return 1;
+            }
+      }
+
+      if(test->expected_reject != PIXEL_FORMAT_ACCEPTED && reject_counts[test->expected_reject] != test->expected_reject_count) {
+            printf("FAIL: %s (%s): %d formats rejected as \"%s\", expected %d\n", test->name, test->table->name, reject_counts[test->expected_reject],
+                   Pixel_Format_Reject_Name(test->expected_reject), test->expected_reject_count);
+            return 1;
+      }
+
+
+      return 0;
+}
+
+
+
+int main(void)
+{
+      int test_count = (int)(sizeof(test_cases) / sizeof(test_cases[0]));
+      int failure_count = Test_Decode();
+      for(int i = 0; i < test_count; ++i) {
+            failure_count += Test_Run_Case(&test_cases[i]);
+      }
+
+      if(failure_count > 0) {
+            printf("pixel_format_test: %d failures\n", failure_count);
+            return 1;
+      }
+      printf("pixel_format_test: decode and %d cases passed\n", test_count);
+
+
+      return 0;
+}
@@ -25,6 +25,14 @@ RESOURCES FOR OPENGL TUTORIALS:
 /* @! */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <assert.h>
+#include <intrin.h> /* _BitScanForward64(), _BitScanForward() */
 
 #include <gl/gl.h>
 
@@ -32,6 +40,644 @@ RESOURCES FOR OPENGL TUTORIALS:
 #include <gl/glext.h>
 #include <gl/wglext.h>
 
+#include "pixel_format.h" /* the pixel format scoring, kept free of windows.h so it can be tested anywhere */
+
+
+
+
+/* @@ compile-time options */
+#define JOB_SYSTEM_BENCHMARK 0 /* set to '1' to run the job system scaling benchmark (1..N worker threads) at startup, it prints the results and exits before any window is created */
+
+/* GL diagnostics (KHR_debug message callback, message aggregation, and performance warning counters). On by default, and compiled out completely when NDEBUG is defined, unless it is set explicitly with /DGL_DIAGNOSTICS=0 or /DGL_DIAGNOSTICS=1 */
+#ifndef GL_DIAGNOSTICS
+#ifdef NDEBUG
+#define GL_DIAGNOSTICS 0
+#else
+#define GL_DIAGNOSTICS 1
+#endif
+#endif
+
+/* logging. Messages below LOG_COMPILE_LEVEL are compiled out entirely (their arguments aren't even evaluated), LOG_BINARY_OUTPUT writes every message to a binary log file that can be decoded later with "win32_window.exe --decode-log <file>", and LOG_BENCHMARK measures the cost of a log call against printf() at startup and exits */
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+#define LOG_BINARY_OUTPUT 0
+#define LOG_BINARY_OUTPUT_PATH "win32_window.binlog"
+#define LOG_BENCHMARK 0
+
+/* checks every simulation snapshot the render side picks up against a checksum the simulation thread wrote with it, which catches a torn snapshot exchange. On unless NDEBUG is defined. */
+#ifndef SIMULATION_VALIDATE_SNAPSHOTS
+#ifdef NDEBUG
+#define SIMULATION_VALIDATE_SNAPSHOTS 0
+#else
+#define SIMULATION_VALIDATE_SNAPSHOTS 1
+#endif
+#endif
+/* @! */
+
+
+
+
+/* @@ asynchronous logger. A log call doesn't format anything, it copies a pointer to its call site (which holds the format string) and the raw argument values into a lock-free single-producer/single-consumer ring buffer owned by the calling thread. A background thread drains every thread's ring, and either formats the messages to stdout or writes the raw records to a binary log file for offline decoding. When a ring is full the message is dropped and counted, so logging never blocks the message pump or the frame. */
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+
+#define LOG_MAX_THREADS 64
+#define LOG_MAX_SITES 1024
+#define LOG_MAX_ARGS 16
+#define LOG_MAX_RECORD_SIZE 512
+#define LOG_MAX_STRING_LENGTH 256 /* "%s" arguments are copied into the record, and truncated past this */
+#define LOG_THREAD_BUFFER_SIZE (1 << 18) /* must be a power of two */
+#define LOG_TEXT_BUFFER_SIZE (1 << 16)
+#define LOG_FLUSH_INTERVAL_MS 10
+#define LOG_SITE_DEFINITION_ID 0xFFFFFFFFu /* record id that marks a call site definition in the binary log */
+#define LOG_PADDING_ID 0u /* record id that pads the end of a ring buffer before it wraps */
+#define LOG_SITE_OVERFLOW_ID (-1) /* Log_Site.id of sites that came after the site table filled up, their messages are formatted synchronously */
+#define LOG_RECORD_ALIGNMENT 16 /* sizeof(Log_Record_Header), so the space left before the end of a ring buffer always fits a whole padding header */
+
+#define LOG_ARG_INT 0
+#define LOG_ARG_LONG 1
+#define LOG_ARG_LONGLONG 2
+#define LOG_ARG_SIZE 3
+#define LOG_ARG_DOUBLE 4
+#define LOG_ARG_STRING 5
+#define LOG_ARG_POINTER 6
+
+/* Every LOG_*() call site gets its own static Log_Site, so the site's address (and the id it gets the first time it is used) identifies the format string. The argument kinds are parsed from the format string once, on first use. */
+typedef struct Log_Site {
+      int level;
+      const char* file;
+      int line;
+      int rate_limit_per_second; /* 0 means no rate limit */
+      volatile LONG id; /* 0 until the site is first used, LOG_SITE_OVERFLOW_ID if it didn't get one */
+      const char* format;
+      int arg_count;
+      unsigned char arg_kinds[LOG_MAX_ARGS];
+      volatile LONG64 rate_window_start; /* any thread may roll the window, the compare-exchange decides which one does */
+      volatile LONG rate_window_count;
+      volatile LONG rate_suppressed_count;
+} Log_Site;
+
+/* every record in a ring buffer (and in the binary log) starts with this header and is followed by the packed arguments, the whole record is padded to a multiple of LOG_RECORD_ALIGNMENT bytes */
+typedef struct Log_Record_Header {
+      unsigned int size;
+      unsigned int site_id;
+      LONGLONG timestamp;
+} Log_Record_Header;
+
+typedef struct __declspec(align(64)) Log_Thread_Buffer {
+      volatile LONG64 write_pos; /* only written by the owning thread */
+      char write_padding[64 - sizeof(LONG64)];
+      volatile LONG64 read_pos; /* only written by the logger thread */
+      char read_padding[64 - sizeof(LONG64)];
+      volatile LONG dropped_count;
+      DWORD thread_id;
+      unsigned char data[LOG_THREAD_BUFFER_SIZE];
+} Log_Thread_Buffer;
+
+typedef struct Logger {
+      Log_Thread_Buffer* volatile buffers[LOG_MAX_THREADS];
+      volatile LONG buffer_count;
+      Log_Site* volatile sites[LOG_MAX_SITES];
+      volatile LONG site_count;
+      int runtime_level; /* messages below this level are dropped at the call site */
+      volatile LONG running;
+      HANDLE thread;
+      HANDLE wake_event;
+      LONGLONG counter_frequency;
+      LONGLONG start_counter;
+      FILE* binary_file;
+      unsigned char site_defined[LOG_MAX_SITES]; /* logger thread only, sites whose definition is already in the binary log */
+      char text[LOG_TEXT_BUFFER_SIZE]; /* logger thread only */
+      int text_length;
+} Logger;
+
+static Logger logger;
+static const char* log_level_names[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+static __declspec(thread) Log_Thread_Buffer* log_thread_buffer = NULL;
+
+#define LOG_RATE_LIMITED(level, max_per_second, ...) do { \
+	    if((level) >= LOG_COMPILE_LEVEL) { \
+		  static Log_Site log_site_ = { (level), __FILE__, __LINE__, (max_per_second) }; \
+		  Log_Write(&log_site_, __VA_ARGS__); \
+	    } \
+      } while(0)
+#define LOG(level, ...) LOG_RATE_LIMITED(level, 0, __VA_ARGS__)
+#define LOG_TRACE(...) LOG(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+/* @! */
+
+
+
+
+/* @@ benchmark suite, see "--benchmark" in Win32_Main(). Every scenario adds named metrics to the results, which are written out as JSON and compared against a baseline file written by a previous run. */
+#define BENCHMARK_MAX_METRICS 128
+#define BENCHMARK_FRAME_COUNT 1000
+#define BENCHMARK_WARMUP_FRAMES 30
+
+typedef struct Benchmark_Options {
+      int enabled;
+      const char* output_path;
+      const char* baseline_path;
+      double tolerance; /* fraction, 0.10 means a metric may get 10% worse than the baseline before it counts as a regression */
+} Benchmark_Options;
+
+typedef struct Benchmark_Metric {
+      const char* scenario;
+      const char* name;
+      double value;
+      int higher_is_better;
+} Benchmark_Metric;
+
+typedef struct Benchmark_Results {
+      Benchmark_Metric metrics[BENCHMARK_MAX_METRICS];
+      int metric_count;
+      LONGLONG counter_frequency;
+      double frame_times_ms[BENCHMARK_FRAME_COUNT];
+      int frame_count;
+} Benchmark_Results;
+
+static Benchmark_Results benchmark_results;
+/* @! */
+
+
+
+
+/* @@ OpenGL procedures. They are loaded in Win32_Main() once the real context is current, and live at file scope so that the code outside of Win32_Main() can use them too. */
+static PFNGLGETSTRINGIPROC glGetStringi = NULL;
+static PFNGLGENBUFFERSPROC glGenBuffers = NULL;
+static PFNGLBINDBUFFERPROC glBindBuffer = NULL;
+static PFNGLBUFFERDATAPROC glBufferData = NULL;
+static PFNGLCREATESHADERPROC glCreateShader = NULL;
+static PFNGLSHADERSOURCEPROC glShaderSource = NULL;
+static PFNGLCOMPILESHADERPROC glCompileShader = NULL;
+static PFNGLCREATEPROGRAMPROC glCreateProgram = NULL;
+static PFNGLATTACHSHADERPROC glAttachShader = NULL;
+static PFNGLLINKPROGRAMPROC glLinkProgram = NULL;
+static PFNGLDELETESHADERPROC glDeleteShader = NULL;
+static PFNGLUSEPROGRAMPROC glUseProgram = NULL;
+static PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer = NULL;
+static PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray = NULL;
+static PFNGLGENVERTEXARRAYSPROC glGenVertexArrays = NULL;
+static PFNGLBINDVERTEXARRAYPROC glBindVertexArray = NULL;
+static PFNGLGETSHADERIVPROC glGetShaderiv = NULL;
+static PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog = NULL;
+static PFNGLGETPROGRAMIVPROC glGetProgramiv = NULL;
+static PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog = NULL;
+static PFNGLBUFFERSUBDATAPROC glBufferSubData = NULL;
+static PFNGLDELETEBUFFERSPROC glDeleteBuffers = NULL;
+static PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays = NULL;
+static PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation = NULL;
+static PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv = NULL;
+static PFNGLCREATEBUFFERSPROC glCreateBuffers = NULL;
+static PFNGLNAMEDBUFFERSTORAGEPROC glNamedBufferStorage = NULL;
+static PFNGLCREATETEXTURESPROC glCreateTextures = NULL;
+static PFNGLTEXTURESTORAGE2DPROC glTextureStorage2D = NULL;
+static PFNGLCREATEFRAMEBUFFERSPROC glCreateFramebuffers = NULL;
+static PFNGLNAMEDFRAMEBUFFERTEXTUREPROC glNamedFramebufferTexture = NULL;
+static PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers = NULL;
+static PFNGLFENCESYNCPROC glFenceSync = NULL;
+static PFNGLCLIENTWAITSYNCPROC glClientWaitSync = NULL;
+static PFNGLDELETESYNCPROC glDeleteSync = NULL;
+static PFNGLGENQUERIESPROC glGenQueries = NULL;
+static PFNGLDELETEQUERIESPROC glDeleteQueries = NULL;
+static PFNGLBEGINQUERYPROC glBeginQuery = NULL;
+static PFNGLENDQUERYPROC glEndQuery = NULL;
+static PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = NULL;
+static PFNGLDISPATCHCOMPUTEPROC glDispatchCompute = NULL;
+static PFNGLDISPATCHCOMPUTEINDIRECTPROC glDispatchComputeIndirect = NULL;
+static PFNGLMEMORYBARRIERPROC glMemoryBarrier = NULL;
+static PFNGLBINDBUFFERBASEPROC glBindBufferBase = NULL;
+static PFNGLDRAWARRAYSINDIRECTPROC glDrawArraysIndirect = NULL;
+static PFNGLUNIFORM1UIPROC glUniform1ui = NULL;
+static PFNGLUNIFORM1FPROC glUniform1f = NULL;
+static PFNGLDELETEPROGRAMPROC glDeleteProgram = NULL;
+static PFNGLGETNAMEDBUFFERSUBDATAPROC glGetNamedBufferSubData = NULL;
+#if GL_DIAGNOSTICS
+static PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback = NULL;
+static PFNGLDEBUGMESSAGECONTROLPROC glDebugMessageControl = NULL;
+#endif
+/* @! */
+
+
+
+
+/* @@ job system. A fixed pool of worker threads where every worker owns a lock-free work-stealing deque (Chase-Lev). The owner pushes and pops at the bottom of its own deque, and idle workers steal from the top of other workers' deques. The thread that calls Job_System_Init() becomes worker 0, which lets the main thread push jobs and help execute them while it waits on a counter. */
+#define JOB_MAX_WORKERS 64
+#define JOB_DEQUE_CAPACITY 4096 /* must be a power of two */
+#define JOB_PARALLEL_FOR_MAX_BATCHES 256
+#define JOB_IDLE_SPIN_COUNT 2048 /* failed find attempts before an idle worker goes to sleep on the wake semaphore */
+#define JOB_CACHE_LINE_SIZE 64
+
+typedef void (*Job_Func)(void* data);
+typedef void (*Job_Range_Func)(void* data, int begin, int end);
+
+#define JOB_MAX_CONTINUATIONS 8 /* jobs that can wait on a single counter through Job_Run_After() */
+
+typedef struct Job {
+      Job_Func func;
+      void* data;
+      struct Job_Counter* counter; /* can be NULL */
+} Job;
+
+/* a counter is incremented for every job that is submitted with it, and decremented when each of those jobs has finished. Dependencies between jobs are expressed at submit time: jobs submitted with Job_Run_After() are parked on the counter as continuations, and only pushed by the job that brings it to zero. */
+typedef struct Job_Counter {
+      volatile LONG value;
+      SRWLOCK lock; /* taken by the last job to finish and by Job_Run_After(), never by the other decrements */
+      int continuation_count;
+      Job continuations[JOB_MAX_CONTINUATIONS];
+} Job_Counter;
+
+typedef struct Job_Worker_Stats {
+      LONG64 jobs_executed;
+      LONG64 steal_attempts;
+      LONG64 steals;
+      LONG64 steal_contention; /* steals that lost the race for the top of the deque to another thief or the owner */
+      LONG64 pop_contention; /* pops of the last job in the deque that lost the race to a thief */
+      LONG64 sleeps;
+} Job_Worker_Stats;
+
+/* each worker is aligned to a cache line, and top/bottom are padded onto their own cache lines, because thieves hammer "top" with compare-exchanges while the owner keeps writing "bottom". */
+typedef struct __declspec(align(64)) Job_Worker {
+      volatile LONG64 top;
+      char top_padding[JOB_CACHE_LINE_SIZE - sizeof(LONG64)];
+      volatile LONG64 bottom;
+      char bottom_padding[JOB_CACHE_LINE_SIZE - sizeof(LONG64)];
+      Job jobs[JOB_DEQUE_CAPACITY];
+      Job_Worker_Stats stats; /* only ever written by the worker that owns it */
+      struct Job_System* system;
+      HANDLE thread;
+      int index;
+      unsigned int random_state;
+} Job_Worker;
+
+typedef struct Job_System {
+      Job_Worker* workers;
+      int worker_count;
+      volatile LONG running;
+      volatile LONG sleeping_count;
+      HANDLE wake_semaphore;
+} Job_System;
+
+typedef struct Job_Parallel_For_Batch {
+      Job_Range_Func func;
+      void* data;
+      int begin;
+      int end;
+} Job_Parallel_For_Batch;
+
+static __declspec(thread) Job_Worker* job_current_worker = NULL; /* the worker owned by the calling thread, NULL on threads outside the job system */
+/* @! */
+
+
+
+
+/* @@ fixed-timestep simulation. The simulation runs on its own thread at SIMULATION_TICKS_PER_SECOND, independent of the frame rate. After each batch of ticks it publishes an immutable snapshot through a lock-free triple buffer. The render side always takes the newest snapshot and interpolates between the two ticks it holds, so neither side ever waits on the other.
+
+The triple buffer has three snapshot slots. The simulation thread owns one "back" slot, and the render side owns one "front" slot. The third slot is the "middle", and the two sides only ever hand slots to each other by swapping with the middle using InterlockedExchange(). */
+#define SIMULATION_TICKS_PER_SECOND 60
+#define SIMULATION_MAX_CATCHUP_TICKS 8 /* if the simulation falls further behind than this it skips ahead instead of trying to catch up */
+#define SIMULATION_SNAPSHOT_INDEX_MASK 0x3
+#define SIMULATION_SNAPSHOT_NEW 0x4 /* set in "exchange" when the middle slot holds a snapshot the render side hasn't taken yet */
+
+/* everything the simulation owns. Simulation_Step() must only depend on this, which is what keeps the simulation deterministic regardless of frame rate or timing */
+typedef struct Simulation_State {
+      float triangle_angle;
+      float triangle_angular_velocity;
+} Simulation_State;
+
+typedef struct Simulation_Snapshot {
+      LONGLONG tick; /* "current" is the state after this many ticks, "previous" is the state one tick earlier */
+      LONGLONG tick_counter; /* the wall clock time "current" was due, in QueryPerformanceCounter() counts. Pauses and skipped ticks move it, and it's published here so the render side never reads the simulation thread's clock. */
+      Simulation_State previous;
+      Simulation_State current;
+      unsigned int checksum;
+} Simulation_Snapshot;
+
+/* the thread that owns the back slot advances this. It's separate from Simulation so the self test can drive the same tick loop with a made up clock. */
+typedef struct Simulation_Clock {
+      Simulation_State state; /* after "tick" ticks */
+      Simulation_State previous_state; /* after "tick" - 1 ticks */
+      LONGLONG tick;
+      LONGLONG next_tick_counter; /* when the next tick is due, in QueryPerformanceCounter() counts */
+} Simulation_Clock;
+
+typedef struct Simulation {
+      Simulation_Snapshot snapshots[3];
+      volatile LONG exchange; /* index of the middle slot, plus SIMULATION_SNAPSHOT_NEW */
+      int back_index; /* simulation thread only */
+      int front_index; /* render side only */
+      LONGLONG counter_frequency;
+      LONGLONG tick_counts; /* length of one tick in QueryPerformanceCounter() counts */
+      volatile LONG running;
+      volatile LONG paused; /* the thread blocks on "wake_event" while paused, and no ticks pass */
+      volatile LONG64 skipped_tick_count;
+      HANDLE thread;
+      HANDLE timer;
+      HANDLE wake_event;
+} Simulation;
+/* @! */
+
+
+
+
+/* @@ GPU resource pool. Buffers, textures and framebuffers are taken from the pool and given back to it instead of being created and deleted, since driver allocations are slow and fragment video memory when they churn. Buffers are pooled by power of two size class, textures by internal format and power of two size class of each dimension, and framebuffers by exact size and internal format. A released resource is only handed out again once every frame that could have used it has finished on the GPU, which is tracked with one fence per frame. Released resources are kept in least recently used order, and the oldest ones are deleted whenever the pool is over its memory budget. */
+#define GPU_POOL_MAX_RESOURCES 4096
+#define GPU_POOL_FRAMES_IN_FLIGHT 4 /* fences we keep before waiting on the oldest one */
+#define GPU_POOL_MIN_BUFFER_SIZE 256 /* smallest buffer size class in bytes */
+#define GPU_POOL_MIN_TEXTURE_SIZE 16 /* smallest texture size class in texels, per dimension */
+
+enum {
+      GPU_RESOURCE_BUFFER,
+      GPU_RESOURCE_TEXTURE,
+      GPU_RESOURCE_FRAMEBUFFER
+};
+
+typedef struct Gpu_Resource {
+      GLuint name; /* the buffer, texture or framebuffer */
+      GLuint texture; /* the attachment of a framebuffer */
+      int kind;
+      GLenum format; /* internal format of textures and framebuffers */
+      GLsizeiptr size; /* buffer size class in bytes */
+      GLsizei width; /* texture size class, or exact framebuffer size */
+      GLsizei height;
+      GLsizeiptr bytes; /* estimated video memory */
+      LONGLONG release_frame; /* can be reused once this frame has retired */
+      int in_use;
+      int lru_prev; /* released resources, most recently released first. "lru_next" also chains the unused slots. */
+      int lru_next;
+} Gpu_Resource;
+
+typedef struct Gpu_Pool_Stats {
+      LONGLONG acquire_count;
+      LONGLONG hit_count; /* acquires served by a pooled resource */
+      LONGLONG eviction_count;
+      LONGLONG evicted_bytes;
+      GLsizeiptr peak_bytes;
+} Gpu_Pool_Stats;
+
+typedef struct Gpu_Pool {
+      Gpu_Resource* resources;
+      int resource_count; /* slots used so far, unused slots below this are chained from "unused_head" */
+      int unused_head;
+      int lru_head;
+      int lru_tail;
+      GLsizeiptr budget_bytes;
+      GLsizeiptr allocated_bytes;
+      LONGLONG frame_index;
+      LONGLONG retired_frame; /* every frame up to and including this one has finished on the GPU */
+      GLsync fences[GPU_POOL_FRAMES_IN_FLIGHT]; /* ring, oldest at "fence_first" */
+      LONGLONG fence_frames[GPU_POOL_FRAMES_IN_FLIGHT];
+      int fence_first;
+      int fence_count;
+      Gpu_Pool_Stats stats;
+} Gpu_Pool;
+/* @! */
+
+
+
+
+/* @@ render scheduler. In on-demand mode a frame is only rendered when something invalidates it (input, a resize, the window being uncovered, an animation timer coming due, or an explicit Render_Invalidate() from any thread), or while something is animating. When there is nothing to render the main thread blocks in MsgWaitForMultipleObjectsEx() until a message, a wake up, or the next timer arrives, so an idle window uses no CPU or GPU time. In continuous mode every loop iteration renders a frame, as before. */
+#define RENDER_INVALIDATE_INPUT 0x1
+#define RENDER_INVALIDATE_RESIZE 0x2
+#define RENDER_INVALIDATE_EXPOSE 0x4
+#define RENDER_INVALIDATE_TIMER 0x8
+#define RENDER_INVALIDATE_REQUEST 0x10
+#define RENDER_INVALIDATE_REASON_COUNT 5
+#define RENDER_SCHEDULER_MAX_TIMERS 16
+
+typedef struct Render_Scheduler {
+      int on_demand;
+      volatile LONG invalidation_flags;
+      HANDLE wake_event; /* lets Render_Invalidate() from other threads wake up the message wait */
+      DWORD thread_id; /* the thread that waits, its own invalidations are seen before it waits, so they don't set "wake_event" */
+      int animating; /* set by the frame, keeps on-demand mode rendering continuously while it's set */
+      LONGLONG timer_due_counters[RENDER_SCHEDULER_MAX_TIMERS]; /* '0' for an unused timer */
+      LONGLONG counter_frequency;
+      LONGLONG start_counter;
+      LONGLONG frames_rendered;
+      LONGLONG loop_count;
+      LONGLONG wait_counts; /* QueryPerformanceCounter() counts spent blocked in the message wait */
+      LONGLONG invalidation_counts[RENDER_INVALIDATE_REASON_COUNT];
+} Render_Scheduler;
+
+static Render_Scheduler render_scheduler;
+/* @! */
+
+
+
+
+/* @@ GPU particle system. Particle state lives only in two shader storage buffers, and compute shaders do all the work each frame: emit appends new particles with an atomic counter, simulate integrates every live particle and compacts the survivors into the other buffer with a second atomic counter, and the buffers swap roles for the next frame. The particle count never comes back to the CPU. Small single invocation passes turn it into the arguments of glDispatchComputeIndirect() for the simulate pass and glDrawArraysIndirect() for rendering, which draws one instanced quad per particle. */
+#define PARTICLE_WORK_GROUP_SIZE 256
+#define PARTICLE_MIN_LIFE 2.0f /* seconds, the shaders get these through PARTICLE_SHADER_HEADER */
+#define PARTICLE_MAX_LIFE 3.0f
+#define PARTICLE_STRINGIFY_VALUE(x) #x
+#define PARTICLE_STRINGIFY(x) PARTICLE_STRINGIFY_VALUE(x) /* expands "x" first */
+#define PARTICLE_SIZE_BYTES 32 /* two vec4s, see "struct Particle" in the shaders */
+#define PARTICLE_CONTROL_DISPATCH_OFFSET 8 /* byte offsets into the control buffer, matching "Control" in the shaders */
+#define PARTICLE_CONTROL_DRAW_OFFSET 20
+#define PARTICLE_CONTROL_SIZE 36
+
+typedef struct Particle_System {
+      Gpu_Pool* pool; /* the buffers are taken from it */
+      Gpu_Resource* buffer_resources[3]; /* the two particle buffers and the control buffer */
+      GLuint particle_buffers[2];
+      GLuint control_buffer; /* alive counters, simulate dispatch arguments, and the draw command */
+      GLuint emit_program;
+      GLuint prepare_program;
+      GLuint simulate_program;
+      GLuint finalize_program;
+      GLuint render_program;
+      GLuint vao; /* empty, the vertex shader reads the particle buffer directly */
+      int source; /* index of the particle buffer holding the live particles */
+      GLuint max_count;
+      double emit_rate; /* particles per second */
+      double emit_accumulator;
+      unsigned int seed;
+      float step_dt; /* the step set up by Particle_System_Prepare(), for Particle_System_Update() to submit */
+      GLuint step_emit_count;
+} Particle_System;
+/* @! */
+
+
+
+
+/* @@ scene graph. Nodes are stored flat, as separate arrays per field (structure of arrays), in depth-first order, so a node's parent always comes before it and its whole subtree is the contiguous range [node, subtree_end). Changing a node's local transform only sets its dirty bit, and setting it to the value it already has doesn't even do that. Scene_Update_World() then finds the dirty nodes 64 at a time from the dirty bitset, and recomputes the world matrices of each dirty subtree in one linear pass, with every parent already up to date. Clean subtrees are never touched. Dirty subtrees are disjoint, so with enough dirty nodes they are spread over the job system. */
+#define SCENE_NO_PARENT -1
+#define SCENE_PARALLEL_MIN_NODES 4096 /* fewer dirty nodes than this are updated on the calling thread, the jobs would cost more than they save */
+#define SCENE_MAX_SPLIT_PASSES 4
+
+typedef struct Scene_Range {
+      int begin;
+      int end;
+} Scene_Range;
+
+typedef struct Scene {
+      int node_count;
+      int capacity;
+      float* translations; /* 3 per node */
+      float* rotations; /* 4 per node, unit quaternion (x, y, z, w) */
+      float* scales; /* 3 per node */
+      float* world_matrices; /* 16 per node, column-major */
+      int* parent_indices; /* SCENE_NO_PARENT for roots */
+      int* subtree_ends; /* one past the node's last descendant */
+      unsigned long long* dirty_bits; /* a set bit means the node's local transform changed */
+      GLuint* draw_vaos; /* what to draw for the node, nothing when "draw_counts" is 0 */
+      GLsizei* draw_counts;
+      Scene_Range* update_ranges; /* scratch space for Scene_Update_World(), "capacity" each */
+      Scene_Range* split_ranges;
+} Scene;
+
+typedef struct Scene_Update_Batch {
+      Scene* scene;
+      const Scene_Range* ranges;
+} Scene_Update_Batch;
+/* @! */
+
+
+
+
+/* @@ windows. Every window is created with the same pixel format, so they can all share the one GL context. Rendering to a window only switches the context's drawable to that window's DC, and the windows are swapped together at the end of the frame. WindowProc() handles the messages of every window, and routes resizes and input by which window they came from. */
+#define WINDOW_SET_MAX_WINDOWS 8
+
+typedef struct App_Window {
+      HWND handle;
+      HDC dc;
+      int client_width;
+      int client_height;
+      int open;
+} App_Window;
+
+typedef struct Window_Set {
+      App_Window windows[WINDOW_SET_MAX_WINDOWS]; /* 0 is the main window, closing it quits */
+      int window_count;
+      HGLRC context;
+      HDC current_dc;
+      int pixel_format_id;
+      PIXELFORMATDESCRIPTOR pixel_fd;
+      HINSTANCE instance;
+      const char* class_name;
+      PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT;
+      LONGLONG make_current_count;
+} Window_Set;
+
+static Window_Set window_set;
+/* @! */
+
+
+
+
+/* @@ per-frame state. WindowProc() only records input events while messages are being pumped, and the frame jobs consume them afterwards on the job system. The main thread waits for the frame jobs to finish before it pumps messages again, so the event queue is never touched by two threads at once. */
+#define INPUT_EVENT_QUEUE_LENGTH 256
+#define FRAME_MAX_DRAW_CMDS 64
+
+typedef struct Input_Event {
+      int window; /* index into the Window_Set */
+      UINT message;
+      WPARAM wParam;
+      LPARAM lParam;
+} Input_Event;
+
+typedef struct Input_Event_Queue {
+      Input_Event events[INPUT_EVENT_QUEUE_LENGTH];
+      int count;
+      int dropped_count;
+} Input_Event_Queue;
+
+typedef struct Input_State {
+      int mouse_window; /* the window "mouse_x" and "mouse_y" are relative to */
+      int mouse_x;
+      int mouse_y;
+      int mouse_wheel;
+      unsigned int mouse_buttons; /* bit 0: left, bit 1: middle, bit 2: right, bit 3: XBUTTON1, bit 4: XBUTTON2 */
+      unsigned char keys_down[256];
+} Input_State;
+
+typedef struct Draw_Cmd {
+      GLuint program;
+      GLuint vao;
+      GLint first;
+      GLsizei count;
+      GLint model_location;
+      GLfloat model[16]; /* column-major model matrix */
+} Draw_Cmd;
+
+typedef struct Frame_State {
+      Job_System* job_system;
+      Job_Counter input_done;
+      Job_Counter simulate_done;
+      LONGLONG counter_frequency;
+      LONGLONG last_counter;
+      LONGLONG frame_index;
+      double time;
+      double delta_time;
+      Input_State input;
+      Simulation* simulation;
+      Simulation_State simulation_state; /* interpolated between the newest two ticks for this frame */
+      int animating; /* the frame changes over time, see Render_Scheduler */
+      int pause_blink; /* the background is lit up, it blinks on a Render_Schedule_Timer() while paused */
+      int pause_blink_pending; /* a blink timer is scheduled */
+      Particle_System* particles; /* NULL without particles */
+      int particles_stepping; /* Frame_Prepare_Particles_Job() prepared a step for the render loop to submit */
+      Scene* scene;
+      int scene_root; /* the triangle, it spins with the simulation */
+      int scene_moons[2]; /* smaller triangles that orbit it */
+      GLuint shader_program;
+      GLint model_location;
+      GLuint vao;
+      Draw_Cmd draw_cmds[FRAME_MAX_DRAW_CMDS];
+      int draw_cmd_count;
+      LONG gl_performance_warnings; /* GL_DEBUG_TYPE_PERFORMANCE messages raised during the previous frame, always 0 without GL_DIAGNOSTICS */
+} Frame_State;
+
+static Input_Event_Queue input_event_queue;
+/* @! */
+
+
+
+
+#if GL_DIAGNOSTICS
+/* @@ GL diagnostics. Every message the driver sends to our glDebugMessageCallback() is deduplicated by (source, type, id, severity) into a fixed hash table, only the first occurrence of each is printed, and the rest are just counted. The callback can come from driver threads if GL_DEBUG_OUTPUT_SYNCHRONOUS is off, so the table is guarded by a lock and the per-frame counters are updated with interlocked operations. */
+#define GL_DIAGNOSTICS_TABLE_SIZE 256 /* must be a power of two */
+#define GL_DIAGNOSTICS_MESSAGE_LENGTH 256
+
+typedef struct GL_Debug_Message_Entry {
+      GLenum source;
+      GLenum type;
+      GLuint id;
+      GLenum severity;
+      LONG64 count;
+      int used;
+      char message[GL_DIAGNOSTICS_MESSAGE_LENGTH];
+} GL_Debug_Message_Entry;
+
+typedef struct GL_Diagnostics {
+      SRWLOCK lock;
+      GL_Debug_Message_Entry entries[GL_DIAGNOSTICS_TABLE_SIZE];
+      int entry_count;
+      LONG64 dropped_count; /* messages that didn't fit in the table, they are still counted in the totals below */
+      int debug_output_enabled;
+      volatile LONG frame_performance_count;
+      volatile LONG frame_error_count;
+      LONG last_frame_performance_count;
+      LONG64 total_performance_count;
+      LONG64 total_error_count;
+} GL_Diagnostics;
+
+static GL_Diagnostics gl_diagnostics;
+/* @! */
+#endif
+
 
 
 
@@ -39,28 +685,241 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 LRESULT CALLBACK DummyGL_WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 static int Check_Extension_Available(const char* extensions_list, const char* extension);
 void* Load_WGL_Proc(const char* proc_name);
+static GLuint Shader_Build_Program(const GLenum* stages, const char** sources, int stage_count, const char* name);
+
+static int Log_Init(void);
+static void Log_Shutdown(void);
+#if LOG_BENCHMARK
+static void Log_Flush(void);
+#endif
+static void Log_Write(Log_Site* site, const char* format, ...);
+static DWORD WINAPI Log_Thread(LPVOID param);
+static int Log_Decode_File(const char* path);
+#if LOG_BENCHMARK
+static void Log_Benchmark(void);
+#endif
+
+#if GL_DIAGNOSTICS
+static int GL_Diagnostics_Init(PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback, PFNGLDEBUGMESSAGECONTROLPROC glDebugMessageControl);
+static LONG GL_Diagnostics_End_Frame(void);
+static void GL_Diagnostics_Print_Summary(void);
+static void APIENTRY GL_Debug_Message_Callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user_param);
+#endif
+
+static int Job_System_Init(Job_System* job_system, int worker_count);
+static void Job_System_Shutdown(Job_System* job_system);
+static void Job_Run(Job_System* job_system, const Job* jobs, int job_count, Job_Counter* counter);
+static void Job_Run_After(Job_System* job_system, const Job* jobs, int job_count, Job_Counter* counter, Job_Counter* dependency);
+static void Job_Wait(Job_System* job_system, Job_Counter* counter);
+static void Job_Parallel_For(Job_System* job_system, int count, int min_batch_size, Job_Range_Func func, void* data);
+static void Job_System_Get_Stats(Job_System* job_system, Job_Worker_Stats* total_stats);
+static void Job_System_Print_Stats(Job_System* job_system);
+static void Job_Counter_Decrement(Job_System* job_system, Job_Counter* counter);
+static DWORD WINAPI Job_Worker_Thread(LPVOID param);
+#if JOB_SYSTEM_BENCHMARK
+static void Job_System_Benchmark(void);
+#endif
+
+static void Benchmark_Add_Metric(Benchmark_Results* results, const char* scenario, const char* name, double value, int higher_is_better);
+static void Benchmark_Extension_Lookup(Benchmark_Results* results, const char* extensions_string);
+static void Benchmark_Input_Dispatch(Benchmark_Results* results, HWND window_handle);
+static void Benchmark_Draw_Submission(Benchmark_Results* results, GLuint shader_program);
+static void Benchmark_Buffer_Upload(Benchmark_Results* results);
+static void Benchmark_Gpu_Pool(Benchmark_Results* results);
+static void Benchmark_Idle_Window(Benchmark_Results* results, Window_Set* set);
+static void Benchmark_Particles(Benchmark_Results* results, Gpu_Pool* pool);
+static void Benchmark_Scene(Benchmark_Results* results, Job_System* job_system);
+static void Benchmark_Window_Count(Benchmark_Results* results, Window_Set* set);
+static void Benchmark_Frame_Times(Benchmark_Results* results);
+static int Benchmark_Write_JSON(Benchmark_Results* results, const char* path);
+static int Benchmark_Compare_Baseline(Benchmark_Results* results, const char* path, double tolerance);
+
+static int Gpu_Pool_Init(Gpu_Pool* pool, GLsizeiptr budget_bytes);
+static void Gpu_Pool_Shutdown(Gpu_Pool* pool);
+static Gpu_Resource* Gpu_Pool_Acquire_Buffer(Gpu_Pool* pool, GLsizeiptr size);
+static Gpu_Resource* Gpu_Pool_Acquire_Texture(Gpu_Pool* pool, GLenum format, GLsizei width, GLsizei height);
+static Gpu_Resource* Gpu_Pool_Acquire_Framebuffer(Gpu_Pool* pool, GLenum format, GLsizei width, GLsizei height);
+static void Gpu_Pool_Release(Gpu_Pool* pool, Gpu_Resource* resource);
+static void Gpu_Pool_End_Frame(Gpu_Pool* pool);
+static void Gpu_Pool_Print_Stats(Gpu_Pool* pool);
+
+static int Render_Scheduler_Init(Render_Scheduler* scheduler, int on_demand);
+static void Render_Scheduler_Shutdown(Render_Scheduler* scheduler);
+static void Render_Invalidate(Render_Scheduler* scheduler, LONG flags);
+static int Render_Schedule_Timer(Render_Scheduler* scheduler, double seconds);
+static void Render_Scheduler_Wait(Render_Scheduler* scheduler, DWORD max_wait_ms);
+static int Render_Scheduler_Begin_Frame(Render_Scheduler* scheduler, LONG* invalidation_flags);
+static void Render_Scheduler_Print_Stats(Render_Scheduler* scheduler);
+
+static int Particle_System_Init(Particle_System* particles, Gpu_Pool* pool, GLuint max_count);
+static void Particle_System_Shutdown(Particle_System* particles);
+static void Particle_System_Prepare(Particle_System* particles, float dt);
+static void Particle_System_Update(Particle_System* particles);
+static void Particle_System_Draw(Particle_System* particles);
+static GLuint Particle_System_Read_Alive_Count(Particle_System* particles);
+
+static int Scene_Init(Scene* scene, int capacity);
+static void Scene_Shutdown(Scene* scene);
+static int Scene_Add_Node(Scene* scene, int parent);
+static void Scene_Set_Translation(Scene* scene, int node, float x, float y, float z);
+static void Scene_Set_Rotation_Z(Scene* scene, int node, float angle);
+static void Scene_Set_Scale(Scene* scene, int node, float x, float y, float z);
+static void Scene_Update_World(Scene* scene, Job_System* job_system);
+static int Scene_Test_Incremental(Job_System* job_system);
+
+static void Window_Set_Init(Window_Set* set, HINSTANCE instance, const char* class_name, HWND main_handle, HDC main_dc, HGLRC context, int pixel_format_id, const PIXELFORMATDESCRIPTOR* pixel_fd, PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT);
+static int Window_Set_Open(Window_Set* set, const char* name, int width, int height);
+static void Window_Set_Close(Window_Set* set, int index);
+static void Window_Set_Shutdown(Window_Set* set);
+static int Window_Set_Find(Window_Set* set, HWND handle);
+static int Window_Set_Bind(Window_Set* set, int index);
+static void Window_Set_Swap(Window_Set* set);
+
+static int Simulation_Init(Simulation* simulation);
+static void Simulation_Shutdown(Simulation* simulation);
+static void Simulation_Step(Simulation_State* state, float dt);
+static const Simulation_Snapshot* Simulation_Acquire_Snapshot(Simulation* simulation);
+static void Simulation_Interpolate(Simulation* simulation, const Simulation_Snapshot* snapshot, LONGLONG now_counter, Simulation_State* state);
+static void Simulation_Set_Paused(Simulation* simulation, int paused);
+static void Simulation_Clock_Init(Simulation* simulation, Simulation_Clock* clock);
+static int Simulation_Run_Due_Ticks(Simulation* simulation, Simulation_Clock* clock, LONGLONG now_counter);
+static DWORD WINAPI Simulation_Thread(LPVOID param);
+static int Simulation_Test_Determinism(void);
+static int Simulation_Test_Exchange(void);
+
+static void Input_Event_Push(HWND window_handle, UINT message, WPARAM wParam, LPARAM lParam);
+static void Frame_Process_Input_Job(void* data);
+static void Frame_Simulate_Job(void* data);
+static void Frame_Prepare_Draw_Job(void* data);
+static void Frame_Prepare_Particles_Job(void* data);
+
+static int Win32_Main(int argc, char** argv);
+
+
+
+
+/* The program itself is Win32_Main(), this only makes sure the log is written out on every return from it. The normal exit path already shut the logger down after the job system and the simulation thread, this catches the early "return 1" error paths.
+*/
+int main(int argc, char** argv)
+{
+      int exit_code = Win32_Main(argc, argv);
+      Log_Shutdown();
+
 
+      return exit_code;
+}
 
 
 
-int main(void)
+static int Win32_Main(int argc, char** argv)
 {
       HINSTANCE hInstance = GetModuleHandleA(NULL); /* since we aren't using wWinMain() or WinMain(), we need to grab the HINSTANCE with this function. */
       int program_running = 1;
+      int exit_code = 0;
       int fullscreen = 1; /* set to '1' if you want fullscreen, '0' if you don't */
 
 
 
       
+      /* @@ starting the logger, and decoding a binary log instead of running if we were asked to */
+      if(argc == 3 && strcmp(argv[1], "--decode-log") == 0) {
+	    return Log_Decode_File(argv[2]);
+      }
+
+      /* "--benchmark <results.json> [--baseline <baseline.json>] [--tolerance <fraction>]" runs the benchmark scenarios, writes the results as JSON, and exits with 1 if anything regressed past the tolerance compared to the baseline */
+      Benchmark_Options benchmark_options;
+      memset(&benchmark_options, 0, sizeof(Benchmark_Options));
+      benchmark_options.tolerance = 0.10;
+      int self_test = 0; /* "--self-test" runs the self tests instead of opening the window, and exits with 1 if any of them failed */
+      for(int i = 1; i < argc; ++i) {
+	    if(strcmp(argv[i], "--self-test") == 0) {
+		  self_test = 1;
+	    } else if(strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+		  benchmark_options.enabled = 1;
+		  benchmark_options.output_path = argv[++i];
+	    } else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+		  benchmark_options.baseline_path = argv[++i];
+	    } else if(strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+		  benchmark_options.tolerance = atof(argv[++i]);
+	    }
+      }
+
+      if(Log_Init() != 1) {
+	    printf("ERROR: Log_Init() failed to start the logger\n");
+	    return 1;
+      }
+
+#if LOG_BENCHMARK
+      Log_Benchmark();
+      return 0;
+#endif
+      /* @! */
+
+
+
+
       /* @@ user variables */
       const char* window_name = "win32 window";
       int window_width = 960;
       int window_height = 540;
+      int job_worker_count = 0; /* number of threads in the job system including the main thread, '0' uses one per logical processor */
+      int msaa_samples = 0; /* samples per pixel of the window's framebuffer, '0' for no MSAA */
+      int srgb_framebuffer = 0; /* set to '1' to require an sRGB capable framebuffer */
+      int render_on_demand = 0; /* set to '1' to only render when something changed (see Render_Scheduler), '0' renders continuously. Space pauses the animation. */
+      int extra_window_count = 0; /* more windows (e.g. monitoring panes) rendered from the main window's context, up to WINDOW_SET_MAX_WINDOWS - 1 */
+      int particle_max_count = 256 * 1024; /* capacity of the GPU particle system, '0' turns it off */
+      int gpu_pool_budget_mb = 256; /* video memory the GPU resource pool may hold before it starts evicting released resources */
+#if GL_DIAGNOSTICS
+      int gl_debug_context = 1; /* set to '1' to create the context with WGL_CONTEXT_DEBUG_BIT_ARB, drivers only report most KHR_debug messages (and validate more) in a debug context */
+#endif
+      /* @! */
+
+
+
+
+#if JOB_SYSTEM_BENCHMARK
+      Job_System_Benchmark();
+      return 0;
+#endif
+
+
+
+
+      /* @@ starting the job system */
+      Job_System job_system;
+      if(Job_System_Init(&job_system, job_worker_count) != 1) {
+	    LOG_ERROR("Job_System_Init() failed to start the job system\n");
+	    return 1;
+      }
+      /* @! */
+
+
+
+
+      /* @@ self tests, they only need the logger and the job system */
+      if(self_test) {
+	    int failure_count = 0;
+	    failure_count += Simulation_Test_Determinism() ? 0 : 1;
+	    failure_count += Simulation_Test_Exchange() ? 0 : 1;
+	    failure_count += Scene_Test_Incremental(&job_system) ? 0 : 1;
+
+	    Job_System_Shutdown(&job_system);
+	    if(failure_count > 0) {
+		  LOG_ERROR("SELF TEST: %d tests failed\n", failure_count);
+	    } else {
+		  LOG_INFO("SELF TEST: all tests passed\n");
+	    }
+	    Log_Shutdown();
+	    return (failure_count > 0) ? 1 : 0;
+      }
       /* @! */
 
 
 
 
+      LARGE_INTEGER startup_counters[4]; /* start of context bootstrap, dummy context current, real context current, GL procedures loaded */
+      QueryPerformanceCounter(&startup_counters[0]);
+
       /* @@ creating dummy GL window */
       const char* dummygl_window_class_name = "DUMMYGL_WINDOW_CLASS";
       WNDCLASSA dummygl_wnd_class;
@@ -76,7 +935,7 @@ int main(void)
       dummygl_wnd_class.lpszClassName = dummygl_window_class_name;
       if(RegisterClassA(&dummygl_wnd_class) == 0) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: RegisterClassA() failed to register window class: %s - win32 error code: %ld\n", dummygl_window_class_name, win32_error_val);
+	    LOG_ERROR("RegisterClassA() failed to register window class: %s - win32 error code: %ld\n", dummygl_window_class_name, win32_error_val);
       }
 
       HWND dummygl_window_handle = CreateWindowA
@@ -93,13 +952,13 @@ int main(void)
 	     NULL);
       if(dummygl_window_handle == NULL) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: CreateWindowA() failed to create dummygl window - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("CreateWindowA() failed to create dummygl window - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
 
       HDC dummygl_DC = GetDC(dummygl_window_handle);
       if(dummygl_DC == NULL) {
-	    printf("ERROR: GetDC() failed to get DC for dummygl window\n");
+	    LOG_ERROR("GetDC() failed to get DC for dummygl window\n");
 	    return 1;
       }
       /* @! */
@@ -141,25 +1000,25 @@ int main(void)
       int dummygl_pixelformat_index = ChoosePixelFormat(dummygl_DC, &dummygl_pfd);
       if(dummygl_pixelformat_index == 0) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: ChoosePixelFormat() failed to get a pixel format that matched - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("ChoosePixelFormat() failed to get a pixel format that matched - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
 
       if(SetPixelFormat(dummygl_DC, dummygl_pixelformat_index, &dummygl_pfd) != TRUE) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: SetPixelFormat() failed to set the pixel format - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("SetPixelFormat() failed to set the pixel format - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
 
       HGLRC dummygl_context = wglCreateContext(dummygl_DC);
       if(dummygl_context == NULL) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: wglCreateContext() failed to create a dummy GL context - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("wglCreateContext() failed to create a dummy GL context - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
       if(wglMakeCurrent(dummygl_DC, dummygl_context) != TRUE) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: wglMakeCurrent() failed to make context current - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("wglMakeCurrent() failed to make context current - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
       /* @! */
@@ -167,6 +1026,7 @@ int main(void)
 
 
       
+      QueryPerformanceCounter(&startup_counters[1]);
       /* @@ loading extensions to create our real Gl context. Now that we have a dummy context, we can load the necessary extension procedures in order to create the real context. */
 
       /* the procedure wglGetExtensionsStringARB() is used to query extensions, but since it is itself part of an extension (WGL_ARB_extensions_string), we can't use the procedure to query itself before we even know if it exists. So, we just have to try to load it. */
@@ -174,7 +1034,7 @@ int main(void)
       wglGetExtensionsStringARB = (PFNWGLGETEXTENSIONSSTRINGARBPROC)
 	    Load_WGL_Proc("wglGetExtensionsStringARB");
       if(wglGetExtensionsStringARB == NULL) {
-	    printf("ERROR: failed to load wglGetExtensionsStringARB()\n");
+	    LOG_ERROR("failed to load wglGetExtensionsStringARB()\n");
 	    return 1;
       }
       
@@ -182,49 +1042,39 @@ int main(void)
       const char * extensions_string = wglGetExtensionsStringARB(dummygl_DC);
       if(extensions_string == NULL) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: wglGetExtensionsStringARB() failed to get the extensions string - win32 (or or WGL_ARB_extensions_string extension) error code: %ld\n", win32_error_val);
+	    LOG_ERROR("wglGetExtensionsStringARB() failed to get the extensions string - win32 (or or WGL_ARB_extensions_string extension) error code: %ld\n", win32_error_val);
 	    return 1;
       }	  
 
       if(Check_Extension_Available(extensions_string, "WGL_ARB_pixel_format") != 1) {
-	    printf("ERROR: WGL_ARB_pixel_format extension not found\n");
+	    LOG_ERROR("WGL_ARB_pixel_format extension not found\n");
 	    return 1;
       }
       if(Check_Extension_Available(extensions_string, "WGL_ARB_create_context_profile") != 1) {
-	    printf("ERROR: WGL_ARB_create_context_profile extension not found\n");
+	    LOG_ERROR("WGL_ARB_create_context_profile extension not found\n");
 	    return 1;
       }
+      /* optional, the pixel format attributes these add can only be queried when they're available */
+      int has_wgl_multisample = Check_Extension_Available(extensions_string, "WGL_ARB_multisample") == 1;
+      int has_wgl_framebuffer_srgb = Check_Extension_Available(extensions_string, "WGL_ARB_framebuffer_sRGB") == 1 ||
+	    Check_Extension_Available(extensions_string, "WGL_EXT_framebuffer_sRGB") == 1;
 
       
       /* These procedure pointers are neccessary to aquire/load in the dummy context, but the remainder of the WGL (and GL) extension procedures should be loaded with the actual context. wglGetExtensionsStringARB() should be loaded again with the new context, but these ones are only neccessary to for context creation, so we don't need them again. */
       PFNWGLGETPIXELFORMATATTRIBIVARBPROC wglGetPixelFormatAttribivARB = NULL;
-      PFNWGLGETPIXELFORMATATTRIBFVARBPROC wglGetPixelFormatAttribfvARB = NULL;
-      PFNWGLCHOOSEPIXELFORMATARBPROC wglChoosePixelFormatARB = NULL;
       PFNWGLCREATECONTEXTATTRIBSARBPROC wglCreateContextAttribsARB = NULL;
       
       wglGetPixelFormatAttribivARB = (PFNWGLGETPIXELFORMATATTRIBIVARBPROC)
 	    Load_WGL_Proc("wglGetPixelFormatAttribivARB");
-      wglGetPixelFormatAttribfvARB = (PFNWGLGETPIXELFORMATATTRIBFVARBPROC)
-	    Load_WGL_Proc("wglGetPixelFormatAttribfvARB");
-      wglChoosePixelFormatARB = (PFNWGLCHOOSEPIXELFORMATARBPROC)
-	    Load_WGL_Proc("wglChoosePixelFormatARB");
       wglCreateContextAttribsARB = (PFNWGLCREATECONTEXTATTRIBSARBPROC)
 	    Load_WGL_Proc("wglCreateContextAttribsARB");
 
       if(wglGetPixelFormatAttribivARB == NULL) {
-	    printf("ERROR: failed to load proc: \"wglGetPixelFormatAttribivARB\"\n");
-	    return 1;
-      }
-      if(wglGetPixelFormatAttribfvARB == NULL) {
-	    printf("ERROR: failed to load proc: \"wglGetPixelFormatAttribfvARB\"\n");
-	    return 1;
-      }
-      if(wglChoosePixelFormatARB == NULL) {
-	    printf("ERROR: failed to load proc: \"wglChoosePixelFormatARB\"\n");
+	    LOG_ERROR("failed to load proc: \"wglGetPixelFormatAttribivARB\"\n");
 	    return 1;
       }
       if(wglCreateContextAttribsARB == NULL) {
-	    printf("ERROR: failed to load proc: \"wglCreateContextAttribsARB\"\n");
+	    LOG_ERROR("failed to load proc: \"wglCreateContextAttribsARB\"\n");
 	    return 1;
       }
       /* @! */
@@ -250,7 +1100,7 @@ int main(void)
 
       if(RegisterClassExA(&wnd_class) == 0) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: RegisterClassA() failed to register window class - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("RegisterClassA() failed to register window class - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
       
@@ -269,13 +1119,13 @@ int main(void)
 	     NULL);
       if(window_handle == NULL) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: CreateWindowExA() failed to create window - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("CreateWindowExA() failed to create window - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
 
       HDC window_DC = GetDC(window_handle);
       if(window_DC == NULL) {
-	    printf("ERROR: GetDC() failed to get DC for window\n");
+	    LOG_ERROR("GetDC() failed to get DC for window\n");
 	    return 1;
       }
       /* @! */
@@ -283,57 +1133,119 @@ int main(void)
 
 
       
-      /* @@ creating the real Gl context */
-      #define PI_ATTRIB_LIST_LENGTH 19
-      int pi_attrib_list[PI_ATTRIB_LIST_LENGTH];
-      pi_attrib_list[0]  = WGL_DRAW_TO_WINDOW_ARB; pi_attrib_list[1]  = TRUE;
-      pi_attrib_list[2]  = WGL_SUPPORT_OPENGL_ARB; pi_attrib_list[3]  = TRUE;
-      pi_attrib_list[4]  = WGL_DOUBLE_BUFFER_ARB;  pi_attrib_list[5]  = TRUE;
-      pi_attrib_list[6]  = WGL_PIXEL_TYPE_ARB;     pi_attrib_list[7]  = WGL_TYPE_RGBA_ARB;
-      pi_attrib_list[8]  = WGL_ACCELERATION_ARB;   pi_attrib_list[9]  = WGL_FULL_ACCELERATION_ARB;
-      pi_attrib_list[10] = WGL_COLOR_BITS_ARB;     pi_attrib_list[11] = 32;
-      pi_attrib_list[12] = WGL_ALPHA_BITS_ARB;     pi_attrib_list[13] = 8;
-      pi_attrib_list[14] = WGL_DEPTH_BITS_ARB;     pi_attrib_list[15] = 24;
-      pi_attrib_list[16] = WGL_STENCIL_BITS_ARB;   pi_attrib_list[17] = 8;
-      pi_attrib_list[18] = 0;
-      /* look into WGL_SAMPLE_BUFFERS_ARB for MSAA */
-
-      int pixel_format_id;
-      UINT num_formats;
-      if(wglChoosePixelFormatARB(window_DC, pi_attrib_list, NULL, 1, &pixel_format_id, &num_formats) != TRUE) {
+      /* @@ choosing the pixel format. Rather than letting wglChoosePixelFormatARB() pick with its own (driver specific) sort order, we read the attributes of every format and pick the cheapest one that meets our policy ourselves, see Pixel_Format_Choose() in pixel_format.h. Nothing is drawn with depth or stencil, so we don't ask for any, and formats that have them pay for it in the score. */
+      Pixel_Format_Policy pixel_format_policy;
+      memset(&pixel_format_policy, 0, sizeof(Pixel_Format_Policy));
+      pixel_format_policy.require_full_acceleration = 1;
+      pixel_format_policy.min_color_bits = 24;
+      pixel_format_policy.min_alpha_bits = 8;
+      pixel_format_policy.min_depth_bits = 0;
+      pixel_format_policy.min_stencil_bits = 0;
+      pixel_format_policy.min_samples = msaa_samples;
+      pixel_format_policy.max_samples = msaa_samples;
+      pixel_format_policy.require_srgb = srgb_framebuffer;
+      pixel_format_policy.prefer_srgb = srgb_framebuffer;
+      pixel_format_policy.prefer_swap_exchange = 1;
+
+      int format_count_attrib = WGL_NUMBER_PIXEL_FORMATS_ARB;
+      int format_count = 0;
+      if(wglGetPixelFormatAttribivARB(window_DC, 0, 0, 1, &format_count_attrib, &format_count) != TRUE || format_count <= 0) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: failed to get pixel format with wglChoosePixelFormatARB() - win32 (or WGL_ARB_pixel_format extension) error code: %ld\n", win32_error_val);
+	    LOG_ERROR("failed to get the number of pixel formats with wglGetPixelFormatAttribivARB() - win32 (or WGL_ARB_pixel_format extension) error code: %ld\n", win32_error_val);
+	    return 1;
+      }
+
+      /* every attribute we score on, queried together in one call per format, see Pixel_Format_Query_Attribs() */
+      int format_attribs[PIXEL_FORMAT_MAX_ATTRIBS];
+      int format_attrib_count = Pixel_Format_Query_Attribs(format_attribs, has_wgl_multisample, has_wgl_framebuffer_srgb);
+
+      Pixel_Format* pixel_formats = (Pixel_Format *)malloc(sizeof(Pixel_Format) * format_count);
+      if(pixel_formats == NULL) {
+	    LOG_ERROR("failed to allocate memory for %d pixel formats\n", format_count);
 	    return 1;
       }
-      if(num_formats == 0) {
-	    printf("ERROR: no pixel formats found as queried with wglChoosePixelFormatARB()\n");
+      for(int i = 0; i < format_count; ++i) {
+	    int id = i + 1; /* pixel format indices start at 1 */
+	    int values[PIXEL_FORMAT_MAX_ATTRIBS] = {0};
+	    if(wglGetPixelFormatAttribivARB(window_DC, id, 0, format_attrib_count, format_attribs, values) != TRUE) {
+		  memset(values, 0, sizeof(values)); /* decodes as not drawable to a window, so it gets rejected */
+	    }
+	    Pixel_Format_Decode(id, format_attribs, values, format_attrib_count, &pixel_formats[i]);
+
+	    /* one row of a table in tests/pixel_format_test.c, which is how the tables there are captured. Only the queried values are printed, the columns of attributes the driver lacks are padded with 0 so every row has the same width. */
+	    if(LOG_LEVEL_TRACE >= LOG_COMPILE_LEVEL) {
+		  char row[256];
+		  int row_length = snprintf(row, sizeof(row), "%d", id);
+		  for(int a = 0; a < PIXEL_FORMAT_MAX_ATTRIBS && row_length < (int)sizeof(row); ++a) {
+			int value = (a < format_attrib_count) ? values[a] : 0;
+			int is_enum = a >= 3 && a <= 5; /* pixel type, acceleration and swap method are WGL enums, which read better in hex */
+			row_length += snprintf(row + row_length, sizeof(row) - (size_t)row_length, is_enum ? ", 0x%X" : ", %d", value);
+		  }
+		  LOG_TRACE("pixel format attribs: { %s },\n", row);
+	    }
+      }
+
+      int reject_counts[PIXEL_FORMAT_REJECT_COUNT];
+      int chosen_format_index = Pixel_Format_Choose(&pixel_format_policy, pixel_formats, format_count, reject_counts);
+      for(int r = 1; r < PIXEL_FORMAT_REJECT_COUNT; ++r) {
+	    if(reject_counts[r] > 0) {
+		  LOG_DEBUG("pixel format: %d of %d formats rejected: %s\n", reject_counts[r], format_count, Pixel_Format_Reject_Name(r));
+	    }
+      }
+      if(chosen_format_index < 0) {
+	    LOG_ERROR("none of the %d pixel formats meet the pixel format policy\n", format_count);
+	    free(pixel_formats);
 	    return 1;
       }
+      {
+	    const Pixel_Format* chosen = &pixel_formats[chosen_format_index];
+	    int chosen_cost;
+	    char reasons[192];
+	    Pixel_Format_Score(&pixel_format_policy, chosen, &chosen_cost, reasons, sizeof(reasons));
+	    LOG_INFO("pixel format: chose %d of %d (color %d, alpha %d, depth %d, stencil %d, samples %d, sRGB %d), cost %d: %s\n",
+		     chosen->id, format_count, chosen->color_bits, chosen->alpha_bits, chosen->depth_bits, chosen->stencil_bits,
+		     chosen->samples, chosen->srgb_capable, chosen_cost, reasons);
+      }
+      int pixel_format_id = pixel_formats[chosen_format_index].id;
+      int pixel_format_srgb_capable = pixel_formats[chosen_format_index].srgb_capable;
+      free(pixel_formats);
+      /* @! */
+
+
+
+      
+      /* @@ creating the real Gl context */
 
       PIXELFORMATDESCRIPTOR pixel_fd;
       if(DescribePixelFormat(window_DC, pixel_format_id, sizeof(PIXELFORMATDESCRIPTOR), &pixel_fd) == 0) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: DescribePixelFormat() failed - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("DescribePixelFormat() failed - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
       if(SetPixelFormat(window_DC, pixel_format_id, &pixel_fd) != TRUE) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: failed to set pixel format with SetPixelFormat() - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("failed to set pixel format with SetPixelFormat() - win32 error code: %ld\n", win32_error_val);
 	    return 1;
       }
 
 
-      #define ATTRIB_LIST_LENGTH 7
+      #define ATTRIB_LIST_LENGTH 9
       int attrib_list[ATTRIB_LIST_LENGTH];
       attrib_list[0] = WGL_CONTEXT_MAJOR_VERSION_ARB; attrib_list[1] = 4;
       attrib_list[2] = WGL_CONTEXT_MINOR_VERSION_ARB; attrib_list[3] = 6;
       attrib_list[4] = WGL_CONTEXT_PROFILE_MASK_ARB; attrib_list[5] = WGL_CONTEXT_CORE_PROFILE_BIT_ARB;
-      attrib_list[6] = 0;
+      attrib_list[6] = WGL_CONTEXT_FLAGS_ARB; attrib_list[7] = 0;
+#if GL_DIAGNOSTICS
+      if(gl_debug_context) {
+	    attrib_list[7] |= WGL_CONTEXT_DEBUG_BIT_ARB;
+      }
+#endif
+      attrib_list[8] = 0;
 
       HGLRC wgl_context = wglCreateContextAttribsARB(window_DC, 0, attrib_list);
       if(wgl_context == NULL) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: failed to create WGL (GL) context - win32 (or WGL_ARB_create_context/WGL_ARB_create_context_profile extension) error code: %ld\n", win32_error_val);
+	    LOG_ERROR("failed to create WGL (GL) context - win32 (or WGL_ARB_create_context/WGL_ARB_create_context_profile extension) error code: %ld\n", win32_error_val);
 	    return 1;
       }
       /* @! */
@@ -343,23 +1255,23 @@ int main(void)
       
       /* @@ cleanup of dummygl stuff */
       if(wglMakeCurrent(dummygl_DC, NULL) != TRUE) { /* making dummy GL context not current */
-	    printf("ERROR: wglMakeCurrent() failed to make context NOT current\n");
+	    LOG_ERROR("wglMakeCurrent() failed to make context NOT current\n");
 	    return 1;
       }
       if(wglDeleteContext(dummygl_context) != TRUE) { /* deleting dummy GL context */
-	    printf("ERROR: wglDeleteContext() failed to delete the dummy GL context\n");
+	    LOG_ERROR("wglDeleteContext() failed to delete the dummy GL context\n");
 	    return 1;
       }
       if(DeleteDC(dummygl_DC) == 0) { /* deleting dummy GL device context */
-	    printf("ERROR: DeleteDC() failed to delete the dummy GL Device Context\n");
+	    LOG_ERROR("DeleteDC() failed to delete the dummy GL Device Context\n");
 	    return 1;
       }
       if(DestroyWindow(dummygl_window_handle) == 0) { /* destroying dummy GL window */
-	    printf("ERROR: DestroyWindow() failed to destroy the dummy GL window\n");
+	    LOG_ERROR("DestroyWindow() failed to destroy the dummy GL window\n");
 	    return 1;
       }
       if(UnregisterClassA(dummygl_window_class_name, hInstance) == 0) { /* unregistering dummy GL window class */
-	    printf("ERROR: UnregisterClassA() failed to unregister the dummy GL window class: %s\n", dummygl_window_class_name);
+	    LOG_ERROR("UnregisterClassA() failed to unregister the dummy GL window class: %s\n", dummygl_window_class_name);
 	    return 1;
       }
       /* @! */
@@ -369,7 +1281,13 @@ int main(void)
       
       /* @@ now we make the real context current, the WGL context */
       if(wglMakeCurrent(window_DC, wgl_context) != TRUE) {
-	    printf("ERROR: wglMakeCurrent() failed to make context current\n");
+	    LOG_ERROR("wglMakeCurrent() failed to make context current\n");
+      }
+      QueryPerformanceCounter(&startup_counters[2]);
+
+      /* an sRGB capable framebuffer only encodes what we write to it while GL_FRAMEBUFFER_SRGB is on, the enable is context state so it covers every window */
+      if(srgb_framebuffer && pixel_format_srgb_capable) {
+	    glEnable(GL_FRAMEBUFFER_SRGB);
       }
       /* @! */
 
@@ -383,7 +1301,7 @@ int main(void)
       wglGetExtensionsStringARB = (PFNWGLGETEXTENSIONSSTRINGARBPROC)
 	    Load_WGL_Proc("wglGetExtensionsStringARB");
       if(wglGetExtensionsStringARB == NULL) {
-	    printf("ERROR: failed to load wglGetExtensionsStringARB()\n");
+	    LOG_ERROR("failed to load wglGetExtensionsStringARB()\n");
 	    return 1;
       }
       extensions_string = wglGetExtensionsStringARB(window_DC); /* grabbing the extensions again */
@@ -394,11 +1312,11 @@ int main(void)
 
       /* it's not necessary to require that these extensions be present, we could leave it as an optional feature, but for our program, we will require them. */
       if(Check_Extension_Available(extensions_string, "WGL_EXT_swap_control") != 1) {
-	    printf("ERROR: WGL_EXT_swap_control extension not found\n");
+	    LOG_ERROR("WGL_EXT_swap_control extension not found\n");
 	    return 1;
       }
       if(Check_Extension_Available(extensions_string, "WGL_EXT_swap_control_tear") != 1) {
-	    printf("ERROR: WGL_EXT_swap_control_tear extension not found\n");
+	    LOG_ERROR("WGL_EXT_swap_control_tear extension not found\n");
 	    return 1;
       }
 
@@ -408,11 +1326,11 @@ int main(void)
 	    Load_WGL_Proc("wglGetSwapIntervalEXT");
 
       if(wglSwapIntervalEXT == NULL) {
-	    printf("ERROR: failed to load proc: \"wglSwapIntervalEXT\"\n");
+	    LOG_ERROR("failed to load proc: \"wglSwapIntervalEXT\"\n");
 	    return 1;
       }
       if(wglGetSwapIntervalEXT == NULL) {
-	    printf("ERROR: failed to load proc: \"wglGetSwapIntervalEXT\"\n");
+	    LOG_ERROR("failed to load proc: \"wglGetSwapIntervalEXT\"\n");
 	    return 1;
       }     
       /* @! */
@@ -421,25 +1339,7 @@ int main(void)
       /* past this point we have everything we need, a window and OpenGL context. Now we just need to load OpenGL function pointers (which we do manually), and then we can start doing some rendering! */
 
       
-      /* @@ Loading OpenGL procedures (we need the "glext.h" header for the function typedefs and declarations). */
-      PFNGLGETSTRINGIPROC glGetStringi = NULL;
-      PFNGLGENBUFFERSPROC glGenBuffers = NULL;
-      PFNGLBINDBUFFERPROC glBindBuffer = NULL;
-      PFNGLBUFFERDATAPROC glBufferData = NULL;
-      PFNGLCREATESHADERPROC glCreateShader = NULL;
-      PFNGLSHADERSOURCEPROC glShaderSource = NULL;
-      PFNGLCOMPILESHADERPROC glCompileShader = NULL;
-      PFNGLCREATEPROGRAMPROC glCreateProgram = NULL;
-      PFNGLATTACHSHADERPROC glAttachShader = NULL;
-      PFNGLLINKPROGRAMPROC glLinkProgram = NULL;
-      PFNGLDELETESHADERPROC glDeleteShader = NULL;
-      PFNGLUSEPROGRAMPROC glUseProgram = NULL;
-      PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer = NULL;
-      PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray = NULL;
-      PFNGLGENVERTEXARRAYSPROC glGenVertexArrays = NULL;
-      PFNGLBINDVERTEXARRAYPROC glBindVertexArray = NULL;
-
-      
+      /* @@ Loading OpenGL procedures (we need the "glext.h" header for the function typedefs and declarations, the pointers themselves are declared at the top of the file). */
       glGetStringi = (PFNGLGETSTRINGIPROC)Load_WGL_Proc((const char *)"glGetStringi");
       glGenBuffers = (PFNGLGENBUFFERSPROC)Load_WGL_Proc((const char *)"glGenBuffers");
       glBindBuffer = (PFNGLBINDBUFFERPROC)Load_WGL_Proc((const char *)"glBindBuffer");
@@ -456,88 +1356,289 @@ int main(void)
       glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)Load_WGL_Proc((const char *)"glEnableVertexAttribArray");
       glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)Load_WGL_Proc((const char *)"glGenVertexArrays");
       glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)Load_WGL_Proc((const char *)"glBindVertexArray");
+      glGetShaderiv = (PFNGLGETSHADERIVPROC)Load_WGL_Proc((const char *)"glGetShaderiv");
+      glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)Load_WGL_Proc((const char *)"glGetShaderInfoLog");
+      glGetProgramiv = (PFNGLGETPROGRAMIVPROC)Load_WGL_Proc((const char *)"glGetProgramiv");
+      glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)Load_WGL_Proc((const char *)"glGetProgramInfoLog");
+      glBufferSubData = (PFNGLBUFFERSUBDATAPROC)Load_WGL_Proc((const char *)"glBufferSubData");
+      glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)Load_WGL_Proc((const char *)"glDeleteBuffers");
+      glDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSPROC)Load_WGL_Proc((const char *)"glDeleteVertexArrays");
+      glGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)Load_WGL_Proc((const char *)"glGetUniformLocation");
+      glUniformMatrix4fv = (PFNGLUNIFORMMATRIX4FVPROC)Load_WGL_Proc((const char *)"glUniformMatrix4fv");
+      glCreateBuffers = (PFNGLCREATEBUFFERSPROC)Load_WGL_Proc((const char *)"glCreateBuffers");
+      glNamedBufferStorage = (PFNGLNAMEDBUFFERSTORAGEPROC)Load_WGL_Proc((const char *)"glNamedBufferStorage");
+      glCreateTextures = (PFNGLCREATETEXTURESPROC)Load_WGL_Proc((const char *)"glCreateTextures");
+      glTextureStorage2D = (PFNGLTEXTURESTORAGE2DPROC)Load_WGL_Proc((const char *)"glTextureStorage2D");
+      glCreateFramebuffers = (PFNGLCREATEFRAMEBUFFERSPROC)Load_WGL_Proc((const char *)"glCreateFramebuffers");
+      glNamedFramebufferTexture = (PFNGLNAMEDFRAMEBUFFERTEXTUREPROC)Load_WGL_Proc((const char *)"glNamedFramebufferTexture");
+      glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)Load_WGL_Proc((const char *)"glDeleteFramebuffers");
+      glFenceSync = (PFNGLFENCESYNCPROC)Load_WGL_Proc((const char *)"glFenceSync");
+      glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)Load_WGL_Proc((const char *)"glClientWaitSync");
+      glDeleteSync = (PFNGLDELETESYNCPROC)Load_WGL_Proc((const char *)"glDeleteSync");
+      glGenQueries = (PFNGLGENQUERIESPROC)Load_WGL_Proc((const char *)"glGenQueries");
+      glDeleteQueries = (PFNGLDELETEQUERIESPROC)Load_WGL_Proc((const char *)"glDeleteQueries");
+      glBeginQuery = (PFNGLBEGINQUERYPROC)Load_WGL_Proc((const char *)"glBeginQuery");
+      glEndQuery = (PFNGLENDQUERYPROC)Load_WGL_Proc((const char *)"glEndQuery");
+      glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)Load_WGL_Proc((const char *)"glGetQueryObjectui64v");
+      glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)Load_WGL_Proc((const char *)"glDispatchCompute");
+      glDispatchComputeIndirect = (PFNGLDISPATCHCOMPUTEINDIRECTPROC)Load_WGL_Proc((const char *)"glDispatchComputeIndirect");
+      glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)Load_WGL_Proc((const char *)"glMemoryBarrier");
+      glBindBufferBase = (PFNGLBINDBUFFERBASEPROC)Load_WGL_Proc((const char *)"glBindBufferBase");
+      glDrawArraysIndirect = (PFNGLDRAWARRAYSINDIRECTPROC)Load_WGL_Proc((const char *)"glDrawArraysIndirect");
+      glUniform1ui = (PFNGLUNIFORM1UIPROC)Load_WGL_Proc((const char *)"glUniform1ui");
+      glUniform1f = (PFNGLUNIFORM1FPROC)Load_WGL_Proc((const char *)"glUniform1f");
+      glDeleteProgram = (PFNGLDELETEPROGRAMPROC)Load_WGL_Proc((const char *)"glDeleteProgram");
+      glGetNamedBufferSubData = (PFNGLGETNAMEDBUFFERSUBDATAPROC)Load_WGL_Proc((const char *)"glGetNamedBufferSubData");
+#if GL_DIAGNOSTICS
+      glDebugMessageCallback = (PFNGLDEBUGMESSAGECALLBACKPROC)Load_WGL_Proc((const char *)"glDebugMessageCallback");
+      glDebugMessageControl = (PFNGLDEBUGMESSAGECONTROLPROC)Load_WGL_Proc((const char *)"glDebugMessageControl");
+#endif
 
       
       if(glGetStringi == NULL) {
-	    printf("ERROR: \"glGetStringi\" function pointer NULL\n");
+	    LOG_ERROR("\"glGetStringi\" function pointer NULL\n");
 	    return 1;
       }
       if(glGenBuffers == NULL) {
-	    printf("ERROR: \"glGenBuffers\" function pointer NULL\n");
+	    LOG_ERROR("\"glGenBuffers\" function pointer NULL\n");
 	    return 1;
       }
       if(glBindBuffer == NULL) {
-	    printf("ERROR: \"glBindBuffer\" function pointer NULL\n");
+	    LOG_ERROR("\"glBindBuffer\" function pointer NULL\n");
 	    return 1;
       }
       if(glBufferData == NULL) {
-	    printf("ERROR: \"glBufferData\" function pointer NULL\n");
+	    LOG_ERROR("\"glBufferData\" function pointer NULL\n");
 	    return 1;
       }
       if(glCreateShader == NULL) {
-	    printf("ERROR: \"glCreateShader\" function pointer NULL\n");
+	    LOG_ERROR("\"glCreateShader\" function pointer NULL\n");
 	    return 1;
       }
       if(glShaderSource == NULL) {
-	    printf("ERROR: \"glShaderSource\" function pointer NULL\n");
+	    LOG_ERROR("\"glShaderSource\" function pointer NULL\n");
 	    return 1;
       }
       if(glCompileShader == NULL) {
-	    printf("ERROR: \"glCompileShader\" function pointer NULL\n");
+	    LOG_ERROR("\"glCompileShader\" function pointer NULL\n");
 	    return 1;
       }
       if(glCreateProgram == NULL) {
-	    printf("ERROR: \"glCreateProgram\" function pointer NULL\n");
+	    LOG_ERROR("\"glCreateProgram\" function pointer NULL\n");
 	    return 1;
       }
       if(glAttachShader == NULL) {
-	    printf("ERROR: \"glAttachShader\" function pointer NULL\n");
+	    LOG_ERROR("\"glAttachShader\" function pointer NULL\n");
 	    return 1;
       }
       if(glLinkProgram == NULL) {
-	    printf("ERROR: \"glLinkProgram\" function pointer NULL\n");
+	    LOG_ERROR("\"glLinkProgram\" function pointer NULL\n");
 	    return 1;
       }
       if(glDeleteShader == NULL) {
-	    printf("ERROR: \"glDeleteShader\" function pointer NULL\n");
+	    LOG_ERROR("\"glDeleteShader\" function pointer NULL\n");
 	    return 1;
       }
       if(glUseProgram == NULL) {
-	    printf("ERROR: \"glUseProgram\" function pointer NULL\n");
+	    LOG_ERROR("\"glUseProgram\" function pointer NULL\n");
 	    return 1;
       }
       if(glVertexAttribPointer == NULL) {
-	    printf("ERROR: \"glVertexAttribPointer\" function pointer NULL\n");
+	    LOG_ERROR("\"glVertexAttribPointer\" function pointer NULL\n");
 	    return 1;
       }
       if(glEnableVertexAttribArray == NULL) {
-	    printf("ERROR: \"glEnableVertexAttribArray\" function pointer NULL\n");
+	    LOG_ERROR("\"glEnableVertexAttribArray\" function pointer NULL\n");
 	    return 1;
       }
       if(glGenVertexArrays == NULL) {
-	    printf("ERROR: \"glGenVertexArrays\" function pointer NULL\n");
+	    LOG_ERROR("\"glGenVertexArrays\" function pointer NULL\n");
 	    return 1;
       }
       if(glBindVertexArray == NULL) {
-	    printf("ERROR: \"glBindVertexArray\" function pointer NULL\n");
+	    LOG_ERROR("\"glBindVertexArray\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetShaderiv == NULL) {
+	    LOG_ERROR("\"glGetShaderiv\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetShaderInfoLog == NULL) {
+	    LOG_ERROR("\"glGetShaderInfoLog\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetProgramiv == NULL) {
+	    LOG_ERROR("\"glGetProgramiv\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetProgramInfoLog == NULL) {
+	    LOG_ERROR("\"glGetProgramInfoLog\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glBufferSubData == NULL) {
+	    LOG_ERROR("\"glBufferSubData\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDeleteBuffers == NULL) {
+	    LOG_ERROR("\"glDeleteBuffers\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDeleteVertexArrays == NULL) {
+	    LOG_ERROR("\"glDeleteVertexArrays\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetUniformLocation == NULL) {
+	    LOG_ERROR("\"glGetUniformLocation\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glUniformMatrix4fv == NULL) {
+	    LOG_ERROR("\"glUniformMatrix4fv\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glCreateBuffers == NULL) {
+	    LOG_ERROR("\"glCreateBuffers\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glNamedBufferStorage == NULL) {
+	    LOG_ERROR("\"glNamedBufferStorage\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glCreateTextures == NULL) {
+	    LOG_ERROR("\"glCreateTextures\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glTextureStorage2D == NULL) {
+	    LOG_ERROR("\"glTextureStorage2D\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glCreateFramebuffers == NULL) {
+	    LOG_ERROR("\"glCreateFramebuffers\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glNamedFramebufferTexture == NULL) {
+	    LOG_ERROR("\"glNamedFramebufferTexture\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDeleteFramebuffers == NULL) {
+	    LOG_ERROR("\"glDeleteFramebuffers\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glFenceSync == NULL) {
+	    LOG_ERROR("\"glFenceSync\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glClientWaitSync == NULL) {
+	    LOG_ERROR("\"glClientWaitSync\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDeleteSync == NULL) {
+	    LOG_ERROR("\"glDeleteSync\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGenQueries == NULL) {
+	    LOG_ERROR("\"glGenQueries\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDeleteQueries == NULL) {
+	    LOG_ERROR("\"glDeleteQueries\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glBeginQuery == NULL) {
+	    LOG_ERROR("\"glBeginQuery\" function pointer NULL\n");
 	    return 1;
       }
+      if(glEndQuery == NULL) {
+	    LOG_ERROR("\"glEndQuery\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetQueryObjectui64v == NULL) {
+	    LOG_ERROR("\"glGetQueryObjectui64v\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDispatchCompute == NULL) {
+	    LOG_ERROR("\"glDispatchCompute\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDispatchComputeIndirect == NULL) {
+	    LOG_ERROR("\"glDispatchComputeIndirect\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glMemoryBarrier == NULL) {
+	    LOG_ERROR("\"glMemoryBarrier\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glBindBufferBase == NULL) {
+	    LOG_ERROR("\"glBindBufferBase\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDrawArraysIndirect == NULL) {
+	    LOG_ERROR("\"glDrawArraysIndirect\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glUniform1ui == NULL) {
+	    LOG_ERROR("\"glUniform1ui\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glUniform1f == NULL) {
+	    LOG_ERROR("\"glUniform1f\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glDeleteProgram == NULL) {
+	    LOG_ERROR("\"glDeleteProgram\" function pointer NULL\n");
+	    return 1;
+      }
+      if(glGetNamedBufferSubData == NULL) {
+	    LOG_ERROR("\"glGetNamedBufferSubData\" function pointer NULL\n");
+	    return 1;
+      }
+      QueryPerformanceCounter(&startup_counters[3]);
+      /* @! */
+
+
+
+
+#if GL_DIAGNOSTICS
+      /* @@ installing the KHR_debug message callback. KHR_debug is core since GL 4.3, so the procs should always be there for our 4.6 context, but we still treat the diagnostics as optional and carry on without them. */
+      if(glDebugMessageCallback == NULL || glDebugMessageControl == NULL) {
+	    LOG_WARN("glDebugMessageCallback()/glDebugMessageControl() not available, GL diagnostics fall back to glGetError() once per frame\n");
+      } else if(GL_Diagnostics_Init(glDebugMessageCallback, glDebugMessageControl) != 1) {
+	    LOG_WARN("failed to enable GL debug output, GL diagnostics fall back to glGetError() once per frame\n");
+      }
+
+      GLint context_flags = 0;
+      glGetIntegerv(GL_CONTEXT_FLAGS, &context_flags);
+      if(gl_debug_context && (context_flags & GL_CONTEXT_FLAG_DEBUG_BIT) == 0) {
+	    LOG_WARN("asked for a debug context but the driver gave us a non-debug one, expect fewer GL debug messages\n");
+      }
       /* @! */
+#endif
 
 
 
       
       /* @@ user settings */
       if(SetWindowTextA(window_handle, window_name) == 0) {
-	    printf("ERROR: SetWindowTextA() failed!\n");
+	    LOG_ERROR("SetWindowTextA() failed!\n");
       }
 
       wglSwapIntervalEXT(-1); /* setting vsync to adaptive vsync (-1), we could also set it to 1 for normal vsync */
+      Window_Set_Init(&window_set, hInstance, window_class_name, window_handle, window_DC, wgl_context, pixel_format_id, &pixel_fd, wglSwapIntervalEXT);
       /* @! */
 
 
 
       
+      /* @@ setting up the GPU resource pool */
+      Gpu_Pool gpu_pool;
+      if(Gpu_Pool_Init(&gpu_pool, (GLsizeiptr)gpu_pool_budget_mb * 1024 * 1024) != 1) {
+	    LOG_ERROR("Gpu_Pool_Init() failed to allocate the GPU resource pool\n");
+	    return 1;
+      }
+      /* @! */
+
+
+
+
       /* @@ setting up rendering of hello triangle */
 #define VERT_SIZE 9
       GLfloat vertices[VERT_SIZE];
@@ -551,13 +1652,12 @@ int main(void)
       vertices[7] = 0.5f;
       vertices[8] = 0.0f;
 
-      /* @TODO: use the new glCreateBuffers() and glNamedBufferStorage() and see if that works! */
-
       const char * vert_shader_source = "#version 460 core\n"
 	    "layout (location = 0) in vec3 vpos;\n"
+	    "uniform mat4 model;\n"
 	    "void main()\n"
 	    "{\n"
-	    "gl_Position = vec4(vpos.x, vpos.y, vpos.z, 1.0);\n"
+	    "gl_Position = model * vec4(vpos.x, vpos.y, vpos.z, 1.0);\n"
 	    "}\n\0";
       const char * frag_shader_source = "#version 460 core\n"
 	    "out vec4 frag_color;\n"
@@ -566,58 +1666,117 @@ int main(void)
 	    "frag_color = vec4(0.1f, 0.7f, 0.5f, 1.0f);\n"
 	    "}\n\0";
 
-      GLuint vert_shader;
-      GLuint frag_shader;
-      GLuint shader_program;
-      
-      vert_shader = glCreateShader(GL_VERTEX_SHADER);
-      frag_shader = glCreateShader(GL_FRAGMENT_SHADER);
-      shader_program = glCreateProgram();
-      
-      glShaderSource(vert_shader, 1, &vert_shader_source, NULL);
-      glShaderSource(frag_shader, 1, &frag_shader_source, NULL);
-
-      glCompileShader(vert_shader);
-      glCompileShader(frag_shader);
-
-      glAttachShader(shader_program, vert_shader);
-      glAttachShader(shader_program, frag_shader);
-
-      glLinkProgram(shader_program);
-
-      glDeleteShader(vert_shader);
-      glDeleteShader(frag_shader);
+      const GLenum shader_stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+      const char* shader_sources[2] = { vert_shader_source, frag_shader_source };
+      GLuint shader_program = Shader_Build_Program(shader_stages, shader_sources, 2, "triangle");
+      if(shader_program == 0) {
+	    LOG_ERROR("Shader_Build_Program() failed to build the triangle shader program\n");
+	    return 1;
+      }
 
 
       GLuint vao;
-      GLuint vbo;
+      Gpu_Resource* vbo = Gpu_Pool_Acquire_Buffer(&gpu_pool, VERT_SIZE * sizeof(GLfloat));
+      if(vbo == NULL) {
+	    LOG_ERROR("Gpu_Pool_Acquire_Buffer() failed to allocate the vertex buffer\n");
+	    return 1;
+      }
       glGenVertexArrays(1, &vao);      
-      glGenBuffers(1, &vbo);
 
       glBindVertexArray(vao);
       
-      glBindBuffer(GL_ARRAY_BUFFER, vbo);
-      glBufferData(GL_ARRAY_BUFFER, VERT_SIZE * sizeof(GLfloat), (const void *)vertices, GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, vbo->name);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, VERT_SIZE * sizeof(GLfloat), (const void *)vertices);
       glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *)0);
       glEnableVertexAttribArray(0);
       /* @! */
 
 
 
-      
-      /* @@ setting fullscreen */
-      if(fullscreen) {
-	    HMONITOR monitor_handle = MonitorFromWindow(window_handle, MONITOR_DEFAULTTONULL);
-	    if(monitor_handle == NULL) {
-		  printf("ERROR: MonitorFromWindow() failed to get a monitor that the window is on. Probably the window doesn't intersect any monitors\n");
-		  return 1;
-	    }
-      
-	    MONITORINFO mi;
-	    mi.cbSize = sizeof(MONITORINFO);
-	    if(GetMonitorInfoA(monitor_handle, &mi) == 0) {
-		  printf("ERROR: GetMonitorInfoA() failed\n");
-		  return 1;
+
+      /* @@ setting up the GPU particle system */
+      Particle_System particles;
+      if(particle_max_count > 0 && Particle_System_Init(&particles, &gpu_pool, (GLuint)particle_max_count) != 1) {
+	    LOG_ERROR("Particle_System_Init() failed to set up the particle system\n");
+	    return 1;
+      }
+      /* @! */
+
+
+
+
+      /* @@ setting up the render scheduler. The benchmark measures frame times of the main loop, so it always renders continuously. */
+      if(Render_Scheduler_Init(&render_scheduler, render_on_demand && !benchmark_options.enabled) != 1) {
+	    LOG_ERROR("Render_Scheduler_Init() failed to set up the render scheduler\n");
+	    return 1;
+      }
+      /* @! */
+
+
+
+
+      /* @@ setting up the per-frame state */
+      Frame_State frame;
+      memset(&frame, 0, sizeof(Frame_State));
+      frame.job_system = &job_system;
+      frame.shader_program = shader_program;
+      frame.model_location = glGetUniformLocation(shader_program, "model");
+      frame.vao = vao;
+      frame.particles = particle_max_count > 0 ? &particles : NULL;
+
+      Scene scene;
+      if(Scene_Init(&scene, 64) != 1) {
+	    LOG_ERROR("Scene_Init() failed to allocate the scene\n");
+	    return 1;
+      }
+      frame.scene = &scene;
+      frame.scene_root = Scene_Add_Node(&scene, SCENE_NO_PARENT);
+      for(int i = 0; i < 2; ++i) {
+	    int moon = Scene_Add_Node(&scene, frame.scene_root);
+	    Scene_Set_Translation(&scene, moon, i == 0 ? 0.7f : -0.7f, 0.0f, 0.0f);
+	    Scene_Set_Scale(&scene, moon, 0.25f, 0.25f, 0.25f);
+	    frame.scene_moons[i] = moon;
+      }
+      for(int i = 0; i < 3; ++i) {
+	    scene.draw_vaos[i] = vao;
+	    scene.draw_counts[i] = 3;
+      }
+
+      LARGE_INTEGER performance_value;
+      QueryPerformanceFrequency(&performance_value);
+      frame.counter_frequency = performance_value.QuadPart;
+      QueryPerformanceCounter(&performance_value);
+      frame.last_counter = performance_value.QuadPart;
+      /* @! */
+
+
+
+
+      /* @@ starting the simulation thread */
+      Simulation simulation;
+      if(Simulation_Init(&simulation) != 1) {
+	    LOG_ERROR("Simulation_Init() failed to start the simulation thread\n");
+	    return 1;
+      }
+      frame.simulation = &simulation;
+      /* @! */
+
+
+
+      
+      /* @@ setting fullscreen */
+      if(fullscreen) {
+	    HMONITOR monitor_handle = MonitorFromWindow(window_handle, MONITOR_DEFAULTTONULL);
+	    if(monitor_handle == NULL) {
+		  LOG_ERROR("MonitorFromWindow() failed to get a monitor that the window is on. Probably the window doesn't intersect any monitors\n");
+		  return 1;
+	    }
+      
+	    MONITORINFO mi;
+	    mi.cbSize = sizeof(MONITORINFO);
+	    if(GetMonitorInfoA(monitor_handle, &mi) == 0) {
+		  LOG_ERROR("GetMonitorInfoA() failed\n");
+		  return 1;
 	    }
 
 	    LONG_PTR window_style = GetWindowLongPtrA(window_handle, GWL_STYLE);
@@ -627,7 +1786,7 @@ int main(void)
 		  /* the return value of SetWindowLongPtrA() could be 0 because the previous window style is 0, but it also returns 0 because of error. This horrible API design means that if 0 is returned, it could either be because of an error, or the function succeeded and returned the window style value for example (which was 0). To solve this, we first check to see if SetWindowLongPtrA() is 0 (after calling SetLastError(0)), and then if GetLastError() is non-zero, then we know there is an error.*/
 		  DWORD win32_error_val = GetLastError();
 		  if(win32_error_val != 0) {
-			printf("ERROR: SetWindowLongPtrA() failed to set the new window style - win32 error code: %ld\n", win32_error_val);
+			LOG_ERROR("SetWindowLongPtrA() failed to set the new window style - win32 error code: %ld\n", win32_error_val);
 			return 1;
 		  }
 	    }
@@ -639,7 +1798,7 @@ int main(void)
 			     mi.rcMonitor.bottom - mi.rcMonitor.top,
 			     SWP_NOOWNERZORDER | SWP_FRAMECHANGED) == 0 ) {
 		  DWORD win32_error_val = GetLastError();
-		  printf("ERROR: SetWindowPos() failed to change to fullscreen mode - win32 error code: %ld\n", win32_error_val);
+		  LOG_ERROR("SetWindowPos() failed to change to fullscreen mode - win32 error code: %ld\n", win32_error_val);
 		  return 1;
 	    }
       }
@@ -653,6 +1812,8 @@ int main(void)
       GetClientRect(window_handle, &window_size);
 
       glViewport(0, 0, window_size.right - window_size.left, window_size.bottom - window_size.top);
+      window_set.windows[0].client_width = window_size.right - window_size.left;
+      window_set.windows[0].client_height = window_size.bottom - window_size.top;
       /* @! */
 
 
@@ -660,14 +1821,57 @@ int main(void)
       
       /* @@ Finally at the end, we show the window, similar to XMapRaised() or XMapWindow() for X11 */
       ShowWindow(window_handle, SW_SHOWNORMAL);
+      for(int i = 0; i < extra_window_count; ++i) {
+	    if(Window_Set_Open(&window_set, "win32 window (pane)", window_width / 2, window_height / 2) < 0) {
+		  LOG_ERROR("Window_Set_Open() failed to open extra window %d\n", i + 1);
+		  return 1;
+	    }
+      }
       /* @! */
 
 
 
       
+      /* @@ benchmark scenarios. These run once everything is set up, the frame time scenario then measures the main loop itself. */
+      if(benchmark_options.enabled) {
+	    memset(&benchmark_results, 0, sizeof(Benchmark_Results));
+	    LARGE_INTEGER performance_frequency;
+	    QueryPerformanceFrequency(&performance_frequency);
+	    benchmark_results.counter_frequency = performance_frequency.QuadPart;
+
+	    double ms_per_count = 1000.0 / (double)performance_frequency.QuadPart;
+	    Benchmark_Add_Metric(&benchmark_results, "context_bootstrap", "dummy_context_ms", (double)(startup_counters[1].QuadPart - startup_counters[0].QuadPart) * ms_per_count, 0);
+	    Benchmark_Add_Metric(&benchmark_results, "context_bootstrap", "real_context_ms", (double)(startup_counters[2].QuadPart - startup_counters[1].QuadPart) * ms_per_count, 0);
+	    Benchmark_Add_Metric(&benchmark_results, "context_bootstrap", "total_ms", (double)(startup_counters[2].QuadPart - startup_counters[0].QuadPart) * ms_per_count, 0);
+	    Benchmark_Add_Metric(&benchmark_results, "extension_lookup", "startup_proc_loading_ms", (double)(startup_counters[3].QuadPart - startup_counters[2].QuadPart) * ms_per_count, 0);
+
+	    Benchmark_Extension_Lookup(&benchmark_results, extensions_string);
+	    Benchmark_Input_Dispatch(&benchmark_results, window_handle);
+	    Benchmark_Draw_Submission(&benchmark_results, shader_program);
+	    Benchmark_Buffer_Upload(&benchmark_results);
+	    Benchmark_Gpu_Pool(&benchmark_results);
+	    Benchmark_Idle_Window(&benchmark_results, &window_set);
+	    Benchmark_Particles(&benchmark_results, &gpu_pool);
+	    Benchmark_Scene(&benchmark_results, &job_system);
+	    Benchmark_Window_Count(&benchmark_results, &window_set);
+
+	    wglSwapIntervalEXT(0); /* the frame time scenario measures the loop itself, not the display's refresh rate */
+      }
+      /* @! */
+
+
+
+
       /* @@ main loop */
       MSG msg;
+      LARGE_INTEGER benchmark_frame_counter;
+      QueryPerformanceCounter(&benchmark_frame_counter);
       while(program_running) {	    
+	    /* @@ waiting until there's something to render, this returns straight away in continuous mode or while animating */
+	    Render_Scheduler_Wait(&render_scheduler, INFINITE);
+	    /* @! */
+
+
 	    /* @@ flush/process/get messages */
 	    while(PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE) != 0) {
 		  if(LOWORD(msg.message) == WM_QUIT) {
@@ -678,21 +1882,98 @@ int main(void)
 		  TranslateMessage(&msg);		  
 		  DispatchMessage(&msg);
 	    }
+	    LONG invalidation_flags;
+	    if(!program_running || Render_Scheduler_Begin_Frame(&render_scheduler, &invalidation_flags) == 0) {
+		  continue;
+	    }
+	    /* @! */
+
+
+	    /* @@ per-frame CPU work, as jobs. The dependencies are set up here at submit time: a job is parked on the counter it depends on and only pushed once that counter reaches zero, so no job ever waits on another. Input processing and then the simulation snapshot are a chain, since each needs the one before. After them the draw preparation (the scene update and the draw list) and the particle step don't share anything, so they are pushed together and run side by side. The scene update only fans out further, with Job_Parallel_For(), once thousands of nodes have changed, which the three nodes of this scene never do. The main thread helps execute jobs while it waits for the frame. */
+	    Job frame_jobs[4];
+	    frame_jobs[0].func = Frame_Process_Input_Job;
+	    frame_jobs[1].func = Frame_Simulate_Job;
+	    frame_jobs[2].func = Frame_Prepare_Draw_Job;
+	    frame_jobs[3].func = Frame_Prepare_Particles_Job;
+	    for(int i = 0; i < 4; ++i) {
+		  frame_jobs[i].data = &frame;
+		  frame_jobs[i].counter = NULL; /* Job_Run() fills this in */
+	    }
+
+	    Job_Counter frame_done = {0};
+	    Job_Run(&job_system, &frame_jobs[0], 1, &frame.input_done);
+	    Job_Run_After(&job_system, &frame_jobs[1], 1, &frame.simulate_done, &frame.input_done);
+	    Job_Run_After(&job_system, &frame_jobs[2], 2, &frame_done, &frame.simulate_done);
+	    Job_Wait(&job_system, &frame_done);
+	    /* @! */
+
+
+	    /* @@ blinking the background while paused. Nothing else changes then, so the blink runs on a scheduler timer and the on-demand loop only wakes up twice a second. */
+	    if(invalidation_flags & RENDER_INVALIDATE_TIMER) {
+		  frame.pause_blink_pending = 0;
+		  frame.pause_blink = simulation.paused && !frame.pause_blink;
+	    }
+	    if(!simulation.paused) {
+		  frame.pause_blink = 0;
+	    } else if(!frame.pause_blink_pending) {
+		  frame.pause_blink_pending = Render_Schedule_Timer(&render_scheduler, 0.5);
+	    }
 	    /* @! */
 
 	    
-	    /* @@ rendering */
-	    glClearColor(0.1f, 0.15f, 0.19f, 1.0f);
-	    glClear(GL_COLOR_BUFFER_BIT);
-	    glUseProgram(shader_program);
-	    glBindVertexArray(vao);
-	    glDrawArrays(GL_TRIANGLES, 0, 3);
+	    /* @@ rendering. Every open window shows the frame. The main window goes last, so it's still current at the start of the next frame: with only the main window open the drawable never switches, and with extra windows it switches once per extra window plus once back to the main window. */
+	    if(frame.particles_stepping) {
+		  Particle_System_Update(&particles);
+	    }
+	    for(int w = window_set.window_count - 1; w >= 0; --w) {
+		  if(!window_set.windows[w].open || Window_Set_Bind(&window_set, w) != 1) {
+			continue;
+		  }
+		  glClearColor(0.1f, 0.15f, frame.pause_blink ? 0.25f : 0.19f, 1.0f);
+		  glClear(GL_COLOR_BUFFER_BIT);
+		  for(int i = 0; i < frame.draw_cmd_count; ++i) {
+			Draw_Cmd* cmd = &frame.draw_cmds[i];
+			glUseProgram(cmd->program);
+			glBindVertexArray(cmd->vao);
+			glUniformMatrix4fv(cmd->model_location, 1, GL_FALSE, cmd->model);
+			glDrawArrays(GL_TRIANGLES, cmd->first, cmd->count);
+		  }
+		  if(particle_max_count > 0) {
+			Particle_System_Draw(&particles);
+		  }
+	    }
 	    /* @! */
 	    
 
 	    /* @@ swapping and synching */
-	    wglSwapLayerBuffers(window_DC, WGL_SWAP_MAIN_PLANE);
+	    Gpu_Pool_End_Frame(&gpu_pool); /* fences the frame's commands before the swap and glFinish() can stall on them */
+	    Window_Set_Swap(&window_set);
 	    glFinish(); /* blocks until all previous GL commands finish, including the buffer swap. */
+	    render_scheduler.animating = frame.animating;
+	    /* @! */
+
+#if GL_DIAGNOSTICS
+	    /* @@ per-frame GL diagnostics, performance warnings are only reported when the count changes from the previous frame so a warning that fires every frame doesn't flood the console */
+	    LONG previous_performance_count = frame.gl_performance_warnings;
+	    frame.gl_performance_warnings = GL_Diagnostics_End_Frame();
+	    if(frame.gl_performance_warnings != previous_performance_count) {
+		  LOG_WARN("GL PERFORMANCE: %ld performance warnings in frame %lld\n", frame.gl_performance_warnings, (long long)frame.frame_index);
+	    }
+	    /* @! */
+#endif
+
+	    /* @@ recording frame times for the benchmark, after a few warm up frames */
+	    if(benchmark_options.enabled) {
+		  LARGE_INTEGER frame_end_counter;
+		  QueryPerformanceCounter(&frame_end_counter);
+		  if(frame.frame_index > BENCHMARK_WARMUP_FRAMES) {
+			benchmark_results.frame_times_ms[benchmark_results.frame_count++] = (double)(frame_end_counter.QuadPart - benchmark_frame_counter.QuadPart) * 1000.0 / (double)benchmark_results.counter_frequency;
+		  }
+		  benchmark_frame_counter = frame_end_counter;
+		  if(benchmark_results.frame_count >= BENCHMARK_FRAME_COUNT) {
+			program_running = 0;
+		  }
+	    }
 	    /* @! */
       }
       /* @! */
@@ -700,26 +1981,62 @@ int main(void)
 
 
       
+      /* @@ writing the benchmark results and comparing them against the baseline */
+      if(benchmark_options.enabled) {
+	    Benchmark_Frame_Times(&benchmark_results);
+	    if(Benchmark_Write_JSON(&benchmark_results, benchmark_options.output_path) != 1) {
+		  exit_code = 1;
+	    }
+	    if(benchmark_options.baseline_path != NULL) {
+		  int regression_count = Benchmark_Compare_Baseline(&benchmark_results, benchmark_options.baseline_path, benchmark_options.tolerance);
+		  if(regression_count != 0) {
+			exit_code = 1;
+		  }
+	    }
+      }
+      /* @! */
+
+
+
+
       /* @@ Cleanup and Exit */
+#if GL_DIAGNOSTICS
+      GL_Diagnostics_Print_Summary();
+#endif
+      Simulation_Shutdown(&simulation);
+      Scene_Shutdown(&scene);
+      Render_Scheduler_Print_Stats(&render_scheduler);
+      Render_Scheduler_Shutdown(&render_scheduler);
+      Window_Set_Shutdown(&window_set);
+      if(particle_max_count > 0) {
+	    Particle_System_Shutdown(&particles);
+      }
+      Gpu_Pool_Release(&gpu_pool, vbo);
+      Gpu_Pool_Print_Stats(&gpu_pool);
+      Gpu_Pool_Shutdown(&gpu_pool);
+      Job_System_Print_Stats(&job_system);
+      Job_System_Shutdown(&job_system);
+      Log_Shutdown(); /* every thread that logs is joined by now, anything logged after this is written synchronously */
+
       if(wglMakeCurrent(window_DC, NULL) != TRUE) { /* making WGL context not current */
-	    printf("ERROR: wglMakeCurrent() failed to make context NOT current\n");
+	    LOG_ERROR("wglMakeCurrent() failed to make context NOT current\n");
       }
       if(wglDeleteContext(wgl_context) != TRUE) { /* deleting WGL context */
-	    printf("ERROR: wglDeleteContext() failed to delete WGL context\n");
+	    LOG_ERROR("wglDeleteContext() failed to delete WGL context\n");
       }
       if(DeleteDC(window_DC) == 0) { /* deleting window device context */
-	    printf("ERROR: DeleteDC() failed to delete window Device Context\n");
+	    LOG_ERROR("DeleteDC() failed to delete window Device Context\n");
       }
       if(DestroyWindow(window_handle) == 0) {
 	    DWORD win32_error_val = GetLastError();
-	    printf("ERROR: failed to destroy window with DestroyWindow() - win32 error code: %ld\n", win32_error_val);
+	    LOG_ERROR("failed to destroy window with DestroyWindow() - win32 error code: %ld\n", win32_error_val);
       }
       if(UnregisterClassA(window_class_name, hInstance) == 0) { /* unregistering window class */
-	    printf("ERROR: UnregisterClassA() failed to unregister window class: %s\n", window_class_name);
+	    LOG_ERROR("UnregisterClassA() failed to unregister window class: %s\n", window_class_name);
       }
 
       
-      return 0;
+      return exit_code;
       /* @! */    
 }
 
@@ -736,84 +2053,110 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
       switch (uMsg) {
 	    /* @@ these are messages that we want to process ourselves */
       case WM_PAINT: {
-	    printf("WM_PAINT\n");
+	    LOG_DEBUG("WM_PAINT\n");
 	    ValidateRect(hwnd, NULL); /* validates the entire client region of the window so that the OS doesn't keep spamming WM_PAINT messages and thus stalling our application message loop. */
+	    Render_Invalidate(&render_scheduler, RENDER_INVALIDATE_EXPOSE); /* the next frame repaints it */
+      } break;
+      case WM_SIZE: {
+	    LOG_DEBUG("WM_SIZE\n");
+	    int window = Window_Set_Find(&window_set, hwnd);
+	    if(window >= 0) { /* WM_SIZE also arrives from inside CreateWindowExA(), before the window is in the set. Window_Set_Init() and Window_Set_Open() read the size themselves. */
+		  window_set.windows[window].client_width = LOWORD(lParam);
+		  window_set.windows[window].client_height = HIWORD(lParam);
+	    }
+	    Render_Invalidate(&render_scheduler, RENDER_INVALIDATE_RESIZE);
       } break;
       case WM_CLOSE: {
-	    printf("WM_CLOSE\n");
-	    PostQuitMessage(0);
+	    LOG_DEBUG("WM_CLOSE\n");
+	    int window = Window_Set_Find(&window_set, hwnd);
+	    if(window > 0) {
+		  Window_Set_Close(&window_set, window); /* closing an extra window only closes that window */
+	    } else {
+		  PostQuitMessage(0);
+	    }
       } break;
 	    /* @! */
 
 	    
 	    /* @@ mouse input */
       case WM_LBUTTONDOWN: {
-	    printf("WM_LBUTTONDOWN\n");
+	    LOG_DEBUG("WM_LBUTTONDOWN\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_LBUTTONUP: {
-	    printf("WM_LBUTTONUP\n");
+	    LOG_DEBUG("WM_LBUTTONUP\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_MBUTTONDOWN: {
-	    printf("WM_MBUTTONDOWN\n");
+	    LOG_DEBUG("WM_MBUTTONDOWN\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_MBUTTONUP: {
-	    printf("WM_MBUTTONUP\n");
+	    LOG_DEBUG("WM_MBUTTONUP\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 
       case WM_RBUTTONDOWN: {
-	    printf("WM_RBUTTONDOWN\n");
+	    LOG_DEBUG("WM_RBUTTONDOWN\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_RBUTTONUP: {
-	    printf("WM_RBUTTONUP\n");
+	    LOG_DEBUG("WM_RBUTTONUP\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 
       case WM_XBUTTONDOWN: {
-	    printf("WM_XBUTTONDOWN: ");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
+	    const char* button_name = "";
 	    if(GET_XBUTTON_WPARAM(wParam) == XBUTTON1) {
-		  printf("XBUTTON1");
+		  button_name = "XBUTTON1";
 	    } else if(GET_XBUTTON_WPARAM(wParam) == XBUTTON2) {
-		  printf("XBUTTON2");
+		  button_name = "XBUTTON2";
 	    }
-	    printf("\n");
+	    LOG_DEBUG("WM_XBUTTONDOWN: %s\n", button_name);
       } break;
 	    
       case WM_XBUTTONUP: {
-	    printf("WM_XBUTTONUP: ");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
+	    const char* button_name = "";
 	    if(GET_XBUTTON_WPARAM(wParam) == XBUTTON1) {
-		  printf("XBUTTON1");
+		  button_name = "XBUTTON1";
 	    } else if(GET_XBUTTON_WPARAM(wParam) == XBUTTON2) {
-		  printf("XBUTTON2");
+		  button_name = "XBUTTON2";
 	    }
-	    printf("\n");
+	    LOG_DEBUG("WM_XBUTTONUP: %s\n", button_name);
       } break;
 
       case WM_MOUSEMOVE: {
-	    printf("WM_MOUSEMOVE\n");
-	    int x_pos = GET_X_LPARAM(lParam);
-	    int y_pos = GET_Y_LPARAM(lParam);
+	    LOG_RATE_LIMITED(LOG_LEVEL_DEBUG, 10, "WM_MOUSEMOVE\n"); /* mouse moves arrive at the mouse polling rate, so they get rate limited */
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam); /* the position is decoded with GET_X_LPARAM()/GET_Y_LPARAM() when the event is processed */
       } break;
 
       case WM_MOUSEWHEEL: {
-	    printf("WM_MOUSEWHEEL\n");
-      }
+	    LOG_DEBUG("WM_MOUSEWHEEL\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
+      } break;
 	    /* @! */
 
 	    
 	    /* @@ keyboard Input */
       case WM_SYSKEYDOWN: {
-	    printf("WM_SYSKEYDOWN\n");
+	    LOG_DEBUG("WM_SYSKEYDOWN\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_SYSKEYUP: {
-	    printf("WM_SYSKEYUP\n");
+	    LOG_DEBUG("WM_SYSKEYUP\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_KEYDOWN: {
-	    printf("WM_KEYDOWN\n");
+	    LOG_DEBUG("WM_KEYDOWN\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
 	    if(wParam == VK_ESCAPE) {
 		  /* quit if user presses the ESC key */
 		  PostQuitMessage(0);
@@ -821,15 +2164,18 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
       } break;
 	    
       case WM_KEYUP: {
-	    printf("WM_KEYUP\n");
+	    LOG_DEBUG("WM_KEYUP\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 
       case WM_CHAR: {
-	    printf("WM_CHAR\n");
+	    LOG_DEBUG("WM_CHAR\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    
       case WM_SYSCHAR: {
-	    printf("WM_SYSCHAR\n");
+	    LOG_DEBUG("WM_SYSCHAR\n");
+	    Input_Event_Push(hwnd, uMsg, wParam, lParam);
       } break;
 	    /* @!*/
 
@@ -915,3 +2261,4334 @@ void* Load_WGL_Proc(const char* proc_name)
       }
       return proc;
 }
+
+
+
+
+/* Compiles "stage_count" shaders of the given stages from "sources", and links them into a program. Returns the program, or 0 (after logging why, with "name" to tell which program) if a shader failed to compile or the program failed to link.
+*/
+static GLuint Shader_Build_Program(const GLenum* stages, const char** sources, int stage_count, const char* name)
+{
+      GLuint program = glCreateProgram();
+      GLint shader_status;
+      GLchar shader_info_log[1024];
+      for(int i = 0; i < stage_count; ++i) {
+	    GLuint shader = glCreateShader(stages[i]);
+	    glShaderSource(shader, 1, &sources[i], NULL);
+	    glCompileShader(shader);
+
+	    glGetShaderiv(shader, GL_COMPILE_STATUS, &shader_status);
+	    if(shader_status != GL_TRUE) {
+		  const char* stage_name = stages[i] == GL_VERTEX_SHADER ? "vertex" : stages[i] == GL_FRAGMENT_SHADER ? "fragment" : "compute";
+		  glGetShaderInfoLog(shader, (GLsizei)sizeof(shader_info_log), NULL, shader_info_log);
+		  LOG_ERROR("%s %s shader failed to compile:\n%s\n", name, stage_name, shader_info_log);
+		  glDeleteShader(shader);
+		  glDeleteProgram(program);
+		  return 0;
+	    }
+	    glAttachShader(program, shader);
+	    glDeleteShader(shader); /* only flagged for deletion while it's attached */
+      }
+
+      glLinkProgram(program);
+      glGetProgramiv(program, GL_LINK_STATUS, &shader_status);
+      if(shader_status != GL_TRUE) {
+	    glGetProgramInfoLog(program, (GLsizei)sizeof(shader_info_log), NULL, shader_info_log);
+	    LOG_ERROR("%s shader program failed to link:\n%s\n", name, shader_info_log);
+	    glDeleteProgram(program);
+	    return 0;
+      }
+
+
+      return program;
+}
+
+
+
+
+/* Starts the logger thread. Log calls made before this (or after Log_Shutdown()) still work, they are just formatted and written synchronously. Returns 1 on success, otherwise 0.
+*/
+static int Log_Init(void)
+{
+      LARGE_INTEGER performance_value;
+      QueryPerformanceFrequency(&performance_value);
+      logger.counter_frequency = performance_value.QuadPart;
+      QueryPerformanceCounter(&performance_value);
+      logger.start_counter = performance_value.QuadPart;
+      logger.runtime_level = LOG_COMPILE_LEVEL;
+
+#if LOG_BINARY_OUTPUT
+      logger.binary_file = fopen(LOG_BINARY_OUTPUT_PATH, "wb");
+      if(logger.binary_file == NULL) {
+	    printf("ERROR: failed to open the binary log file: %s\n", LOG_BINARY_OUTPUT_PATH);
+	    return 0;
+      }
+      /* file header: magic, QueryPerformanceFrequency(), and the counter value that timestamps are relative to */
+      fwrite("W32BLOG1", 1, 8, logger.binary_file);
+      fwrite(&logger.counter_frequency, sizeof(LONGLONG), 1, logger.binary_file);
+      fwrite(&logger.start_counter, sizeof(LONGLONG), 1, logger.binary_file);
+#endif
+
+      logger.wake_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+      if(logger.wake_event == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    printf("ERROR: CreateEventA() failed to create the logger wake event - win32 error code: %ld\n", win32_error_val);
+	    return 0;
+      }
+
+      logger.running = 1;
+      logger.thread = CreateThread(NULL, 0, Log_Thread, NULL, 0, NULL);
+      if(logger.thread == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    printf("ERROR: CreateThread() failed to create the logger thread - win32 error code: %ld\n", win32_error_val);
+	    logger.running = 0;
+	    CloseHandle(logger.wake_event);
+	    return 0;
+      }
+
+
+      return 1;
+}
+
+
+
+/* Writes out everything that is still buffered and stops the logger thread. Win32_Main() calls it in its cleanup once the job system and the simulation thread are shut down, so no other thread can still be logging, and again after Win32_Main() returns for the early "return 1" error paths. Calling it more than once is fine.
+*/
+static void Log_Shutdown(void)
+{
+      if(logger.thread == NULL) {
+	    return;
+      }
+
+      InterlockedExchange(&logger.running, 0);
+      SetEvent(logger.wake_event);
+      WaitForSingleObject(logger.thread, INFINITE);
+      CloseHandle(logger.thread);
+      CloseHandle(logger.wake_event);
+      logger.thread = NULL;
+
+      LONG64 dropped_count = 0;
+      for(LONG i = 0; i < logger.buffer_count && i < LOG_MAX_THREADS; ++i) {
+	    if(logger.buffers[i] != NULL) {
+		  dropped_count += logger.buffers[i]->dropped_count;
+	    }
+      }
+      if(dropped_count > 0) {
+	    printf("WARNING: the logger dropped %lld messages because a thread's log buffer was full\n", (long long)dropped_count);
+      }
+
+      if(logger.binary_file != NULL) {
+	    fclose(logger.binary_file);
+	    logger.binary_file = NULL;
+      }
+}
+
+
+
+#if LOG_BENCHMARK
+/* Blocks until the logger thread has written out every message that was logged before this call.
+*/
+static void Log_Flush(void)
+{
+      if(!logger.running) {
+	    return;
+      }
+
+      for(LONG i = 0; i < logger.buffer_count && i < LOG_MAX_THREADS; ++i) {
+	    Log_Thread_Buffer* buffer = logger.buffers[i];
+	    if(buffer == NULL) {
+		  continue;
+	    }
+	    LONG64 write_pos = buffer->write_pos;
+	    while(buffer->read_pos < write_pos) {
+		  SetEvent(logger.wake_event);
+		  Sleep(1);
+	    }
+      }
+      /* the logger thread writes the text out after it has advanced read_pos, so give it a moment to finish that too */
+      SetEvent(logger.wake_event);
+      Sleep(LOG_FLUSH_INTERVAL_MS);
+}
+#endif
+
+
+
+/* Reads the next conversion specification out of a printf() format string. "p" must point just past the '%'. The spec (including the '%') is copied into "spec", the kind of argument it consumes goes into "kind" (or -1 for "%%" and anything we don't understand), and the number of '*' width/precision arguments that come before it goes into "star_count". Returns a pointer just past the spec.
+*/
+static const char* Log_Scan_Spec(const char* p, char* spec, int spec_capacity, int* kind, int* star_count)
+{
+      int length = 0;
+      spec[length++] = '%';
+      *kind = -1;
+      *star_count = 0;
+
+      if(*p == '%') {
+	    spec[length++] = '%';
+	    spec[length] = '\0';
+	    return p + 1;
+      }
+
+      int long_count = 0;
+      int size_modifier = 0;
+      int int64_modifier = 0;
+      while(*p != '\0' && length < spec_capacity - 1) {
+	    char c = *p;
+	    spec[length++] = c;
+	    p += 1;
+
+	    if(c == '*') {
+		  *star_count += 1;
+	    } else if(c == 'l') {
+		  long_count += 1;
+	    } else if(c == 'z' || c == 't') {
+		  size_modifier = 1;
+	    } else if(c == 'j') {
+		  long_count = 2;
+	    } else if(c == 'I') {
+		  /* MSVC "I64", "I32" and plain "I" (size_t) */
+		  if(p[0] == '6' && p[1] == '4') {
+			int64_modifier = 1;
+			spec[length++] = *p++;
+			spec[length++] = *p++;
+		  } else if(p[0] == '3' && p[1] == '2') {
+			spec[length++] = *p++;
+			spec[length++] = *p++;
+		  } else {
+			size_modifier = 1;
+		  }
+	    } else if(c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' || c == 'c') {
+		  if(long_count >= 2 || int64_modifier) {
+			*kind = LOG_ARG_LONGLONG;
+		  } else if(long_count == 1) {
+			*kind = LOG_ARG_LONG;
+		  } else if(size_modifier) {
+			*kind = LOG_ARG_SIZE;
+		  } else {
+			*kind = LOG_ARG_INT;
+		  }
+		  break;
+	    } else if(c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A') {
+		  *kind = LOG_ARG_DOUBLE;
+		  break;
+	    } else if(c == 's') {
+		  *kind = LOG_ARG_STRING;
+		  break;
+	    } else if(c == 'p') {
+		  *kind = LOG_ARG_POINTER;
+		  break;
+	    } else if(!((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == ' ' || c == '#' || c == 'h' || c == 'L')) {
+		  break; /* not something we understand, it gets copied through as text */
+	    }
+      }
+      spec[length] = '\0';
+
+
+      return p;
+}
+
+
+
+/* Works out the kinds of every argument "format" consumes. Returns the number of arguments. */
+static int Log_Parse_Format(const char* format, unsigned char* arg_kinds)
+{
+      char spec[32];
+      int arg_count = 0;
+      const char* p = format;
+      while(*p != '\0') {
+	    if(*p != '%') {
+		  p += 1;
+		  continue;
+	    }
+
+	    int kind;
+	    int star_count;
+	    p = Log_Scan_Spec(p + 1, spec, sizeof(spec), &kind, &star_count);
+	    if(kind < 0) {
+		  continue;
+	    }
+	    for(int i = 0; i < star_count && arg_count < LOG_MAX_ARGS; ++i) {
+		  arg_kinds[arg_count++] = LOG_ARG_INT;
+	    }
+	    if(arg_count < LOG_MAX_ARGS) {
+		  arg_kinds[arg_count++] = (unsigned char)kind;
+	    }
+      }
+
+
+      return arg_count;
+}
+
+
+
+/* Formats the packed arguments of a record with its format string, the same way printf() would have. Returns the number of characters written to "out", which is always NUL terminated.
+*/
+static int Log_Format_Record(const char* format, const unsigned char* payload, int payload_size, char* out, int out_capacity)
+{
+      char spec[48];
+      char string_arg[LOG_MAX_STRING_LENGTH + 1];
+      int length = 0;
+      int offset = 0;
+      const char* p = format;
+
+      while(*p != '\0' && length < out_capacity - 1) {
+	    if(*p != '%') {
+		  out[length++] = *p++;
+		  continue;
+	    }
+
+	    int kind;
+	    int star_count;
+	    char raw_spec[32];
+	    p = Log_Scan_Spec(p + 1, raw_spec, sizeof(raw_spec), &kind, &star_count);
+	    if(kind < 0) {
+		  /* "%%" becomes a single '%', anything else we don't understand is copied through as it is */
+		  const char* text = (strcmp(raw_spec, "%%") == 0) ? "%" : raw_spec;
+		  for(int i = 0; text[i] != '\0' && length < out_capacity - 1; ++i) {
+			out[length++] = text[i];
+		  }
+		  continue;
+	    }
+
+	    /* substitute the values of any '*' arguments into the spec */
+	    int spec_length = 0;
+	    for(int i = 0; raw_spec[i] != '\0' && spec_length < (int)sizeof(spec) - 12; ++i) {
+		  if(raw_spec[i] == '*') {
+			long long star_value = 0;
+			if(offset + 8 <= payload_size) {
+			      memcpy(&star_value, payload + offset, 8);
+			      offset += 8;
+			}
+			spec_length += snprintf(spec + spec_length, sizeof(spec) - (size_t)spec_length, "%d", (int)star_value);
+		  } else {
+			spec[spec_length++] = raw_spec[i];
+		  }
+	    }
+	    spec[spec_length] = '\0';
+
+	    int remaining = out_capacity - length;
+	    int written = 0;
+	    if(kind == LOG_ARG_STRING) {
+		  unsigned int string_length = 0;
+		  if(offset + 4 <= payload_size) {
+			memcpy(&string_length, payload + offset, 4);
+			offset += 4;
+		  }
+		  if(string_length > LOG_MAX_STRING_LENGTH || offset + (int)string_length > payload_size) {
+			string_length = 0;
+		  }
+		  memcpy(string_arg, payload + offset, string_length);
+		  string_arg[string_length] = '\0';
+		  offset += (int)string_length;
+		  written = snprintf(out + length, (size_t)remaining, spec, string_arg);
+	    } else {
+		  unsigned char value[8] = {0};
+		  if(offset + 8 <= payload_size) {
+			memcpy(value, payload + offset, 8);
+			offset += 8;
+		  }
+		  long long integer_value;
+		  double double_value;
+		  memcpy(&integer_value, value, 8);
+		  memcpy(&double_value, value, 8);
+		  switch(kind) {
+		  case LOG_ARG_INT: { written = snprintf(out + length, (size_t)remaining, spec, (int)integer_value); } break;
+		  case LOG_ARG_LONG: { written = snprintf(out + length, (size_t)remaining, spec, (long)integer_value); } break;
+		  case LOG_ARG_LONGLONG: { written = snprintf(out + length, (size_t)remaining, spec, integer_value); } break;
+		  case LOG_ARG_SIZE: { written = snprintf(out + length, (size_t)remaining, spec, (size_t)integer_value); } break;
+		  case LOG_ARG_DOUBLE: { written = snprintf(out + length, (size_t)remaining, spec, double_value); } break;
+		  case LOG_ARG_POINTER: { written = snprintf(out + length, (size_t)remaining, spec, (void *)(ULONG_PTR)integer_value); } break;
+		  default: break;
+		  }
+	    }
+	    if(written > 0) {
+		  length += (written < remaining) ? written : remaining - 1;
+	    }
+      }
+      out[length] = '\0';
+
+
+      return length;
+}
+
+
+
+/* Gives the site an id and parses its format string. Several threads can race to register the same site, in which case only one id sticks and the other is simply never used. Once the site table is full the site gets LOG_SITE_OVERFLOW_ID, so it isn't registered again on every call and site_count never goes past the table.
+*/
+static void Log_Register_Site(Log_Site* site, const char* format)
+{
+      site->format = format;
+      site->arg_count = Log_Parse_Format(format, site->arg_kinds);
+
+      LONG id;
+      for(;;) {
+	    LONG site_count = logger.site_count;
+	    if(site_count >= LOG_MAX_SITES - 1) {
+		  InterlockedCompareExchange(&site->id, LOG_SITE_OVERFLOW_ID, 0);
+		  return;
+	    }
+	    id = site_count + 1;
+	    if(InterlockedCompareExchange(&logger.site_count, id, site_count) == site_count) {
+		  break;
+	    }
+      }
+      logger.sites[id] = site;
+      InterlockedCompareExchange(&site->id, id, 0);
+}
+
+
+
+/* Writes the "[seconds] LEVEL " prefix every text message starts with, the timestamp is relative to the logger start. Returns the number of characters written.
+*/
+static int Log_Format_Prefix(int level, LONGLONG timestamp, LONGLONG counter_frequency, char* out, int out_capacity)
+{
+      double seconds = (counter_frequency > 0) ? (double)timestamp / (double)counter_frequency : 0.0;
+      const char* level_name = (level >= LOG_LEVEL_TRACE && level <= LOG_LEVEL_ERROR) ? log_level_names[level] : "?????";
+      int written = snprintf(out, (size_t)out_capacity, "[%12.6f] %s ", seconds, level_name);
+      if(written < 0) {
+	    out[0] = '\0';
+	    return 0;
+      }
+
+
+      return (written < out_capacity) ? written : out_capacity - 1;
+}
+
+
+
+/* Packs the arguments for "site" into "out": integers, doubles, and pointers as 8 bytes each, strings as a 4 byte length followed by the characters. Returns the number of bytes written. */
+static int Log_Pack_Args(const Log_Site* site, unsigned char* out, int capacity, va_list args)
+{
+      int size = 0;
+      for(int i = 0; i < site->arg_count; ++i) {
+	    if(site->arg_kinds[i] == LOG_ARG_STRING) {
+		  const char* string = va_arg(args, const char *);
+		  if(string == NULL) {
+			string = "(null)";
+		  }
+		  unsigned int string_length = (unsigned int)strlen(string);
+		  if(string_length > LOG_MAX_STRING_LENGTH) {
+			string_length = LOG_MAX_STRING_LENGTH;
+		  }
+		  if(size + 4 + (int)string_length > capacity) {
+			break;
+		  }
+		  memcpy(out + size, &string_length, 4);
+		  memcpy(out + size + 4, string, string_length);
+		  size += 4 + (int)string_length;
+		  continue;
+	    }
+
+	    if(size + 8 > capacity) {
+		  break;
+	    }
+	    long long integer_value = 0;
+	    double double_value = 0.0;
+	    int is_double = 0;
+	    switch(site->arg_kinds[i]) {
+	    case LOG_ARG_INT: { integer_value = va_arg(args, int); } break;
+	    case LOG_ARG_LONG: { integer_value = va_arg(args, long); } break;
+	    case LOG_ARG_LONGLONG: { integer_value = va_arg(args, long long); } break;
+	    case LOG_ARG_SIZE: { integer_value = (long long)va_arg(args, size_t); } break;
+	    case LOG_ARG_POINTER: { integer_value = (long long)(ULONG_PTR)va_arg(args, void *); } break;
+	    case LOG_ARG_DOUBLE: { double_value = va_arg(args, double); is_double = 1; } break;
+	    default: break;
+	    }
+	    if(is_double) {
+		  memcpy(out + size, &double_value, 8);
+	    } else {
+		  memcpy(out + size, &integer_value, 8);
+	    }
+	    size += 8;
+      }
+
+
+      return size;
+}
+
+
+
+/* Copies a finished record into the calling thread's ring buffer. Returns 1 on success, or 0 if the buffer is full. */
+static int Log_Push_Record(Log_Thread_Buffer* buffer, const unsigned char* record, unsigned int size)
+{
+      LONG64 write_pos = buffer->write_pos;
+      LONG64 read_pos = buffer->read_pos;
+      unsigned int offset = (unsigned int)(write_pos & (LOG_THREAD_BUFFER_SIZE - 1));
+      unsigned int space_to_end = LOG_THREAD_BUFFER_SIZE - offset;
+      unsigned int needed = size + ((size > space_to_end) ? space_to_end : 0);
+
+      if(write_pos + needed - read_pos > LOG_THREAD_BUFFER_SIZE) {
+	    InterlockedIncrement(&buffer->dropped_count);
+	    return 0;
+      }
+
+      if(size > space_to_end) {
+	    /* records never wrap, the rest of the buffer becomes padding and the record starts at the beginning. Every record is a multiple of LOG_RECORD_ALIGNMENT, so the rest is at least a whole header. */
+	    Log_Record_Header padding;
+	    padding.size = space_to_end;
+	    padding.site_id = LOG_PADDING_ID;
+	    padding.timestamp = 0;
+	    memcpy(buffer->data + offset, &padding, sizeof(Log_Record_Header));
+	    write_pos += space_to_end;
+	    offset = 0;
+      }
+      memcpy(buffer->data + offset, record, size);
+      InterlockedExchange64(&buffer->write_pos, write_pos + size); /* full barrier, publishes the record to the logger thread */
+
+      if(write_pos + size - read_pos > LOG_THREAD_BUFFER_SIZE / 2) {
+	    SetEvent(logger.wake_event); /* wake the logger early instead of waiting for its next flush interval */
+      }
+
+
+      return 1;
+}
+
+
+
+/* Writes a message for "site". This is what the LOG_*() macros call, use those instead of calling this directly. */
+static void Log_Write(Log_Site* site, const char* format, ...)
+{
+      if(site->level < logger.runtime_level) {
+	    return;
+      }
+      if(site->id == 0) {
+	    Log_Register_Site(site, format);
+      }
+
+      LARGE_INTEGER now;
+      QueryPerformanceCounter(&now);
+
+      if(site->rate_limit_per_second > 0) {
+	    LONG64 window_start = site->rate_window_start;
+	    if(now.QuadPart - window_start >= logger.counter_frequency &&
+	       InterlockedCompareExchange64(&site->rate_window_start, now.QuadPart, window_start) == window_start) {
+		  /* only the thread that rolled the window resets it */
+		  LONG suppressed_count = InterlockedExchange(&site->rate_suppressed_count, 0);
+		  InterlockedExchange(&site->rate_window_count, 0);
+		  if(suppressed_count > 0) {
+			LOG_INFO("(rate limit suppressed %ld messages from %s:%d)\n", suppressed_count, site->file, site->line);
+		  }
+	    }
+	    if(InterlockedIncrement(&site->rate_window_count) > site->rate_limit_per_second) {
+		  InterlockedIncrement(&site->rate_suppressed_count);
+		  return;
+	    }
+      }
+
+      unsigned char record[LOG_MAX_RECORD_SIZE];
+      Log_Record_Header header;
+      va_list args;
+      va_start(args, format);
+      int payload_size = Log_Pack_Args(site, record + sizeof(Log_Record_Header), LOG_MAX_RECORD_SIZE - (int)sizeof(Log_Record_Header), args);
+      va_end(args);
+
+      header.size = ((unsigned int)sizeof(Log_Record_Header) + (unsigned int)payload_size + (LOG_RECORD_ALIGNMENT - 1)) & ~(LOG_RECORD_ALIGNMENT - 1u);
+      header.site_id = (site->id > 0) ? (unsigned int)site->id : LOG_PADDING_ID;
+      header.timestamp = now.QuadPart - logger.start_counter;
+      memcpy(record, &header, sizeof(Log_Record_Header));
+
+      Log_Thread_Buffer* buffer = log_thread_buffer;
+      if(buffer == NULL && logger.running) {
+	    LONG index = InterlockedIncrement(&logger.buffer_count) - 1;
+	    if(index < LOG_MAX_THREADS) {
+		  buffer = (Log_Thread_Buffer *)VirtualAlloc(NULL, sizeof(Log_Thread_Buffer), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		  if(buffer != NULL) {
+			buffer->thread_id = GetCurrentThreadId();
+			logger.buffers[index] = buffer;
+			log_thread_buffer = buffer;
+		  }
+	    }
+      }
+
+      if(buffer != NULL && site->id > 0 && logger.running) {
+	    Log_Push_Record(buffer, record, header.size);
+	    if(site->level >= LOG_LEVEL_ERROR) {
+		  SetEvent(logger.wake_event);
+	    }
+	    return;
+      }
+
+      /* no logger thread (yet), or we ran out of thread buffers or site ids, so we format it ourselves */
+      char text[LOG_MAX_RECORD_SIZE * 2];
+      int prefix_length = Log_Format_Prefix(site->level, header.timestamp, logger.counter_frequency, text, (int)sizeof(text));
+      Log_Format_Record(format, record + sizeof(Log_Record_Header), payload_size, text + prefix_length, (int)sizeof(text) - prefix_length);
+      fputs(text, stdout);
+}
+
+
+
+/* Writes a call site definition to the binary log, the first time one of the site's records is written. */
+static void Log_Write_Site_Definition(unsigned int site_id)
+{
+      Log_Site* site = logger.sites[site_id];
+      unsigned int format_length = (unsigned int)strlen(site->format);
+      unsigned int file_length = (unsigned int)strlen(site->file);
+      unsigned int size = ((unsigned int)sizeof(Log_Record_Header) + 4 * 5 + format_length + file_length + 7u) & ~7u;
+
+      Log_Record_Header header;
+      header.size = size;
+      header.site_id = LOG_SITE_DEFINITION_ID;
+      header.timestamp = 0;
+      int level = site->level;
+      int line = site->line;
+      fwrite(&header, sizeof(Log_Record_Header), 1, logger.binary_file);
+      fwrite(&site_id, 4, 1, logger.binary_file);
+      fwrite(&level, 4, 1, logger.binary_file);
+      fwrite(&line, 4, 1, logger.binary_file);
+      fwrite(&format_length, 4, 1, logger.binary_file);
+      fwrite(site->format, 1, format_length, logger.binary_file);
+      fwrite(&file_length, 4, 1, logger.binary_file);
+      fwrite(site->file, 1, file_length, logger.binary_file);
+
+      unsigned char zeros[8] = {0};
+      unsigned int written = (unsigned int)sizeof(Log_Record_Header) + 4 * 5 + format_length + file_length;
+      if(written < size) {
+	    fwrite(zeros, 1, size - written, logger.binary_file);
+      }
+      logger.site_defined[site_id] = 1;
+}
+
+
+
+static void Log_Flush_Text(void)
+{
+      if(logger.text_length > 0) {
+	    fwrite(logger.text, 1, (size_t)logger.text_length, stdout);
+	    fflush(stdout);
+	    logger.text_length = 0;
+      }
+}
+
+
+
+/* Drains every thread's ring buffer once. Returns the number of records written. */
+static int Log_Drain(void)
+{
+      int record_count = 0;
+      for(LONG i = 0; i < logger.buffer_count && i < LOG_MAX_THREADS; ++i) {
+	    Log_Thread_Buffer* buffer = logger.buffers[i];
+	    if(buffer == NULL) {
+		  continue;
+	    }
+
+	    LONG64 read_pos = buffer->read_pos;
+	    LONG64 write_pos = buffer->write_pos;
+	    while(read_pos < write_pos) {
+		  const unsigned char* record = buffer->data + (read_pos & (LOG_THREAD_BUFFER_SIZE - 1));
+		  Log_Record_Header header;
+		  memcpy(&header, record, sizeof(Log_Record_Header));
+
+		  if(header.site_id != LOG_PADDING_ID && header.site_id < LOG_MAX_SITES && logger.sites[header.site_id] != NULL) {
+			Log_Site* site = logger.sites[header.site_id];
+			int payload_size = (int)header.size - (int)sizeof(Log_Record_Header);
+
+			int to_text = 1;
+			if(logger.binary_file != NULL) {
+			      if(!logger.site_defined[header.site_id]) {
+				    Log_Write_Site_Definition(header.site_id);
+			      }
+			      fwrite(record, 1, header.size, logger.binary_file);
+			      to_text = site->level >= LOG_LEVEL_WARN; /* warnings and errors still go to the console with binary output */
+			}
+			if(to_text) {
+			      if(LOG_TEXT_BUFFER_SIZE - logger.text_length < LOG_MAX_RECORD_SIZE * 2) {
+				    Log_Flush_Text();
+			      }
+			      logger.text_length += Log_Format_Prefix(site->level, header.timestamp, logger.counter_frequency, logger.text + logger.text_length, LOG_TEXT_BUFFER_SIZE - logger.text_length);
+			      logger.text_length += Log_Format_Record(site->format, record + sizeof(Log_Record_Header), payload_size, logger.text + logger.text_length, LOG_TEXT_BUFFER_SIZE - logger.text_length);
+			}
+			record_count += 1;
+		  }
+
+		  read_pos += header.size;
+	    }
+	    InterlockedExchange64(&buffer->read_pos, read_pos); /* full barrier, we are done reading the records before the producer can overwrite them */
+      }
+
+      Log_Flush_Text();
+
+
+      return record_count;
+}
+
+
+
+/* Reports the messages that rate limited sites suppressed in a window that has since ended. Log_Write() only reports them the next time the site is used, which never comes once a burst is over. With "all" the current windows are reported too, which is what shutdown wants.
+*/
+static void Log_Report_Suppressed(int all)
+{
+      LARGE_INTEGER now;
+      QueryPerformanceCounter(&now);
+      for(LONG id = 1; id <= logger.site_count && id < LOG_MAX_SITES; ++id) {
+	    Log_Site* site = logger.sites[id];
+	    if(site == NULL || site->rate_limit_per_second == 0 || site->rate_suppressed_count == 0) {
+		  continue;
+	    }
+	    if(!all && now.QuadPart - site->rate_window_start < logger.counter_frequency) {
+		  continue;
+	    }
+
+	    /* the exchange makes sure that only one of us and Log_Write() reports each suppressed message */
+	    LONG suppressed_count = InterlockedExchange(&site->rate_suppressed_count, 0);
+	    if(suppressed_count > 0) {
+		  LOG_INFO("(rate limit suppressed %ld messages from %s:%d)\n", suppressed_count, site->file, site->line);
+	    }
+      }
+}
+
+
+
+/* Logger thread procedure, drains the ring buffers every LOG_FLUSH_INTERVAL_MS or whenever a producer wakes it, and one last time on shutdown. Suppressed counts of rate limited sites are reported on the same interval, and on shutdown after the last drain (by then the logger isn't running, so those messages are written straight out). */
+static DWORD WINAPI Log_Thread(LPVOID param)
+{
+      for(;;) {
+	    LONG running = logger.running;
+	    Log_Drain();
+	    Log_Report_Suppressed(!running);
+	    if(!running) {
+		  break;
+	    }
+	    WaitForSingleObject(logger.wake_event, LOG_FLUSH_INTERVAL_MS);
+      }
+
+      if(logger.binary_file != NULL) {
+	    fflush(logger.binary_file);
+      }
+
+
+      return 0;
+}
+
+
+
+/* Decodes a binary log written with LOG_BINARY_OUTPUT into text on stdout, with each message prefixed by its timestamp in seconds. Returns 0 on success, otherwise 1 (it is used as the process exit code).
+*/
+static int Log_Decode_File(const char* path)
+{
+      FILE* file = fopen(path, "rb");
+      if(file == NULL) {
+	    printf("ERROR: failed to open binary log file: %s\n", path);
+	    return 1;
+      }
+
+      char magic[8];
+      LONGLONG counter_frequency;
+      LONGLONG start_counter;
+      if(fread(magic, 1, 8, file) != 8 || memcmp(magic, "W32BLOG1", 8) != 0 ||
+	 fread(&counter_frequency, sizeof(LONGLONG), 1, file) != 1 ||
+	 fread(&start_counter, sizeof(LONGLONG), 1, file) != 1 ||
+	 counter_frequency <= 0) {
+	    printf("ERROR: not a binary log file: %s\n", path);
+	    fclose(file);
+	    return 1;
+      }
+
+      /* the definitions are only kept for as long as the decoder runs, so they are simply leaked into these tables */
+      static char* formats[LOG_MAX_SITES];
+      static int levels[LOG_MAX_SITES];
+      unsigned char record[4096]; /* large enough for site definitions, which hold the whole format string and file name */
+      char text[LOG_MAX_RECORD_SIZE * 2];
+
+      Log_Record_Header header;
+      while(fread(&header, sizeof(Log_Record_Header), 1, file) == 1) {
+	    if(header.size < sizeof(Log_Record_Header) || header.size - sizeof(Log_Record_Header) > sizeof(record)) {
+		  printf("ERROR: corrupt record in binary log file: %s\n", path);
+		  fclose(file);
+		  return 1;
+	    }
+	    unsigned int payload_size = header.size - (unsigned int)sizeof(Log_Record_Header);
+	    if(fread(record, 1, payload_size, file) != payload_size) {
+		  break; /* truncated at the end, e.g. the program crashed */
+	    }
+
+	    if(header.site_id == LOG_SITE_DEFINITION_ID) {
+		  unsigned int site_id;
+		  unsigned int format_length;
+		  int level;
+		  memcpy(&site_id, record, 4);
+		  memcpy(&level, record + 4, 4);
+		  memcpy(&format_length, record + 12, 4);
+		  if(site_id < LOG_MAX_SITES && 16 + format_length <= payload_size) {
+			formats[site_id] = (char *)malloc(format_length + 1);
+			if(formats[site_id] != NULL) {
+			      memcpy(formats[site_id], record + 16, format_length);
+			      formats[site_id][format_length] = '\0';
+			}
+			levels[site_id] = level;
+		  }
+		  continue;
+	    }
+	    if(header.site_id >= LOG_MAX_SITES || formats[header.site_id] == NULL) {
+		  continue;
+	    }
+
+	    int prefix_length = Log_Format_Prefix(levels[header.site_id], header.timestamp, counter_frequency, text, (int)sizeof(text));
+	    Log_Format_Record(formats[header.site_id], record, (int)payload_size, text + prefix_length, (int)sizeof(text) - prefix_length);
+	    fputs(text, stdout);
+      }
+
+      fclose(file);
+
+
+      return 0;
+}
+
+
+
+#if LOG_BENCHMARK
+#define LOG_BENCHMARK_CALLS 4096
+#define LOG_BENCHMARK_ROUNDS 16
+
+/* Measures the cost of a single log call on the calling thread, against printf() of the same message. Each round logs fewer messages than fit in the ring buffer and then flushes, so none get dropped and the formatting/writing cost lands on the logger thread where it belongs.
+*/
+static void Log_Benchmark(void)
+{
+      LARGE_INTEGER start;
+      LARGE_INTEGER end;
+      double frequency = (double)logger.counter_frequency;
+      double log_ns = 0.0;
+      double printf_ns = 0.0;
+      double filtered_ns = 0.0;
+      double rate_limited_ns = 0.0;
+
+      for(int round = 0; round < LOG_BENCHMARK_ROUNDS; ++round) {
+	    QueryPerformanceCounter(&start);
+	    for(int i = 0; i < LOG_BENCHMARK_CALLS; ++i) {
+		  LOG_INFO("benchmark message %d from %s: %f\n", i, "Log_Benchmark", 0.5 * i);
+	    }
+	    QueryPerformanceCounter(&end);
+	    log_ns += (double)(end.QuadPart - start.QuadPart) * 1e9 / frequency;
+	    Log_Flush();
+
+	    QueryPerformanceCounter(&start);
+	    for(int i = 0; i < LOG_BENCHMARK_CALLS; ++i) {
+		  printf("benchmark message %d from %s: %f\n", i, "Log_Benchmark", 0.5 * i);
+	    }
+	    QueryPerformanceCounter(&end);
+	    printf_ns += (double)(end.QuadPart - start.QuadPart) * 1e9 / frequency;
+	    fflush(stdout);
+
+	    QueryPerformanceCounter(&start);
+	    for(int i = 0; i < LOG_BENCHMARK_CALLS; ++i) {
+		  LOG_RATE_LIMITED(LOG_LEVEL_INFO, 10, "rate limited benchmark message %d\n", i);
+	    }
+	    QueryPerformanceCounter(&end);
+	    rate_limited_ns += (double)(end.QuadPart - start.QuadPart) * 1e9 / frequency;
+	    Log_Flush();
+
+	    int saved_level = logger.runtime_level;
+	    logger.runtime_level = LOG_LEVEL_ERROR;
+	    QueryPerformanceCounter(&start);
+	    for(int i = 0; i < LOG_BENCHMARK_CALLS; ++i) {
+		  LOG_INFO("filtered benchmark message %d\n", i);
+	    }
+	    QueryPerformanceCounter(&end);
+	    filtered_ns += (double)(end.QuadPart - start.QuadPart) * 1e9 / frequency;
+	    logger.runtime_level = saved_level;
+      }
+
+      double call_count = (double)LOG_BENCHMARK_CALLS * LOG_BENCHMARK_ROUNDS;
+      printf("LOG BENCHMARK: %d calls per case\n", LOG_BENCHMARK_CALLS * LOG_BENCHMARK_ROUNDS);
+      printf("  LOG_INFO()                   %8.1f ns/call\n", log_ns / call_count);
+      printf("  printf()                     %8.1f ns/call\n", printf_ns / call_count);
+      printf("  LOG_RATE_LIMITED() (10/s)    %8.1f ns/call\n", rate_limited_ns / call_count);
+      printf("  LOG_INFO() below run level   %8.1f ns/call\n", filtered_ns / call_count);
+}
+#endif
+
+
+
+
+/* Starts the job system with "worker_count" threads in total, where the calling thread counts as worker 0 and the rest are created here. A "worker_count" of 0 (or less) uses one worker per logical processor. Returns 1 on success, otherwise 0.
+*/
+static int Job_System_Init(Job_System* job_system, int worker_count)
+{
+      if(worker_count <= 0) {
+	    SYSTEM_INFO system_info;
+	    GetSystemInfo(&system_info);
+	    worker_count = (int)system_info.dwNumberOfProcessors;
+      }
+      if(worker_count > JOB_MAX_WORKERS) {
+	    worker_count = JOB_MAX_WORKERS;
+      }
+      if(worker_count < 1) {
+	    worker_count = 1;
+      }
+
+      memset(job_system, 0, sizeof(Job_System));
+      job_system->worker_count = worker_count;
+      job_system->running = 1;
+
+      /* VirtualAlloc() gives us page aligned (and zeroed) memory, so every worker ends up cache line aligned */
+      job_system->workers = (Job_Worker *)VirtualAlloc(NULL, sizeof(Job_Worker) * (size_t)worker_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+      if(job_system->workers == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("VirtualAlloc() failed to allocate the job system workers - win32 error code: %ld\n", win32_error_val);
+	    return 0;
+      }
+
+      job_system->wake_semaphore = CreateSemaphoreA(NULL, 0, LONG_MAX, NULL); /* Job_Push() releases for sleepers that may not have consumed the last release yet, so the count can run past the worker count */
+      if(job_system->wake_semaphore == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("CreateSemaphoreA() failed to create the job system wake semaphore - win32 error code: %ld\n", win32_error_val);
+	    VirtualFree(job_system->workers, 0, MEM_RELEASE);
+	    return 0;
+      }
+
+      for(int i = 0; i < worker_count; ++i) {
+	    Job_Worker* worker = &job_system->workers[i];
+	    worker->system = job_system;
+	    worker->index = i;
+	    worker->random_state = 0x9E3779B9u * (unsigned int)(i + 1);
+      }
+      job_current_worker = &job_system->workers[0];
+
+      for(int i = 1; i < worker_count; ++i) {
+	    Job_Worker* worker = &job_system->workers[i];
+	    worker->thread = CreateThread(NULL, 0, Job_Worker_Thread, worker, 0, NULL);
+	    if(worker->thread == NULL) {
+		  DWORD win32_error_val = GetLastError();
+		  LOG_ERROR("CreateThread() failed to create job worker thread %d - win32 error code: %ld\n", i, win32_error_val);
+		  job_system->worker_count = i; /* only shut down the threads that actually started */
+		  Job_System_Shutdown(job_system);
+		  return 0;
+	    }
+      }
+
+
+      return 1;
+}
+
+
+
+/* Stops and joins every worker thread and frees the job system. Any jobs still sitting in the deques are dropped, so the caller should wait on its counters first.
+*/
+static void Job_System_Shutdown(Job_System* job_system)
+{
+      InterlockedExchange(&job_system->running, 0);
+      if(ReleaseSemaphore(job_system->wake_semaphore, job_system->worker_count, NULL) == 0) {
+	    LOG_WARN("ReleaseSemaphore() failed to wake the job system workers - win32 error code: %ld\n", (long)GetLastError());
+      }
+
+      for(int i = 1; i < job_system->worker_count; ++i) {
+	    Job_Worker* worker = &job_system->workers[i];
+	    if(worker->thread != NULL) {
+		  /* a worker that went to sleep after the release above would never wake, so keep releasing until it has exited */
+		  while(WaitForSingleObject(worker->thread, 10) == WAIT_TIMEOUT) {
+			ReleaseSemaphore(job_system->wake_semaphore, 1, NULL);
+		  }
+		  CloseHandle(worker->thread);
+		  worker->thread = NULL;
+	    }
+      }
+
+      if(job_current_worker != NULL && job_current_worker->system == job_system) {
+	    job_current_worker = NULL;
+      }
+      CloseHandle(job_system->wake_semaphore);
+      VirtualFree(job_system->workers, 0, MEM_RELEASE);
+      job_system->workers = NULL;
+      job_system->worker_count = 0;
+}
+
+
+
+/* Pushes "job" onto the bottom of the worker's own deque. Only the owning worker may call this. Returns 1 on success, or 0 if the deque is full.
+*/
+static int Job_Deque_Push(Job_Worker* worker, const Job* job)
+{
+      LONG64 bottom = worker->bottom;
+      LONG64 top = worker->top;
+      if(bottom - top >= JOB_DEQUE_CAPACITY) {
+	    return 0;
+      }
+
+      worker->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)] = *job;
+      InterlockedExchange64(&worker->bottom, bottom + 1); /* full barrier, the job has to be visible to thieves before the new bottom is */
+      return 1;
+}
+
+
+
+/* Pops a job off the bottom of the worker's own deque. Only the owning worker may call this. Returns 1 if a job was written to "job", otherwise 0.
+*/
+static int Job_Deque_Pop(Job_Worker* worker, Job* job)
+{
+      LONG64 bottom = worker->bottom - 1;
+      InterlockedExchange64(&worker->bottom, bottom); /* full barrier, thieves must see the new bottom before we read top */
+      LONG64 top = worker->top;
+
+      if(top > bottom) {
+	    /* empty */
+	    worker->bottom = bottom + 1;
+	    return 0;
+      }
+
+      *job = worker->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)];
+      if(top == bottom) {
+	    /* this is the last job, so we race any thieves for it on the top index */
+	    int won = InterlockedCompareExchange64(&worker->top, top + 1, top) == top;
+	    worker->bottom = bottom + 1;
+	    if(!won) {
+		  worker->stats.pop_contention += 1;
+		  return 0;
+	    }
+      }
+      return 1;
+}
+
+
+
+/* Steals a job off the top of another worker's deque. Returns 1 if a job was written to "job", 0 if the deque was empty, or -1 if another thread won the race for the job.
+
+The job is copied out before the compare-exchange on top. That is safe because the owner only ever overwrites the slot at "top" after top has moved on, in which case our compare-exchange fails and the copy is thrown away.
+*/
+static int Job_Deque_Steal(Job_Worker* victim, Job* job)
+{
+      LONG64 top = victim->top;
+      MemoryBarrier(); /* top has to be read before bottom */
+      LONG64 bottom = victim->bottom;
+      if(top >= bottom) {
+	    return 0;
+      }
+
+      Job stolen_job = victim->jobs[top & (JOB_DEQUE_CAPACITY - 1)];
+      if(InterlockedCompareExchange64(&victim->top, top + 1, top) != top) {
+	    return -1;
+      }
+      *job = stolen_job;
+      return 1;
+}
+
+
+
+/* Finds a job for "self" to run, first from its own deque and then by stealing from the other workers, starting at a random one. Returns 1 if a job was written to "job", otherwise 0.
+*/
+static int Job_Find(Job_System* job_system, Job_Worker* self, Job* job)
+{
+      if(Job_Deque_Pop(self, job)) {
+	    return 1;
+      }
+
+      int worker_count = job_system->worker_count;
+      if(worker_count < 2) {
+	    return 0;
+      }
+
+      /* xorshift32 */
+      unsigned int x = self->random_state;
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      self->random_state = x;
+
+      int start = (int)(x % (unsigned int)worker_count);
+      for(int i = 0; i < worker_count; ++i) {
+	    int victim_index = (start + i) % worker_count;
+	    if(victim_index == self->index) {
+		  continue;
+	    }
+
+	    self->stats.steal_attempts += 1;
+	    int result = Job_Deque_Steal(&job_system->workers[victim_index], job);
+	    if(result == 1) {
+		  self->stats.steals += 1;
+		  return 1;
+	    }
+	    if(result == -1) {
+		  self->stats.steal_contention += 1;
+	    }
+      }
+
+
+      return 0;
+}
+
+
+
+static void Job_Execute(Job_Worker* self, const Job* job)
+{
+      job->func(job->data);
+      if(job->counter != NULL) {
+	    Job_Counter_Decrement(self->system, job->counter);
+      }
+      self->stats.jobs_executed += 1;
+}
+
+
+
+/* Pushes jobs whose counters have already been incremented onto the calling worker's deque, and wakes sleeping workers for them. When it is called from a thread that isn't one of the job system's workers, or the deque is full, the job is executed immediately on the calling thread instead.
+*/
+static void Job_Push(Job_System* job_system, const Job* jobs, int job_count)
+{
+      Job_Worker* self = job_current_worker;
+      if(self == NULL || self->system != job_system) {
+	    for(int i = 0; i < job_count; ++i) {
+		  jobs[i].func(jobs[i].data);
+		  if(jobs[i].counter != NULL) {
+			Job_Counter_Decrement(job_system, jobs[i].counter);
+		  }
+	    }
+	    return;
+      }
+
+      for(int i = 0; i < job_count; ++i) {
+	    if(Job_Deque_Push(self, &jobs[i]) == 0) {
+		  Job_Execute(self, &jobs[i]);
+	    }
+      }
+
+      MemoryBarrier(); /* the pushes have to be visible before we read the sleeping count */
+      LONG sleeping_count = job_system->sleeping_count;
+      if(sleeping_count > 0) {
+	    ReleaseSemaphore(job_system->wake_semaphore, sleeping_count < job_count ? sleeping_count : job_count, NULL);
+      }
+}
+
+
+
+/* Counts one finished job of "counter". Every decrement but the last is a plain compare-exchange. The last one happens under the counter's lock, and takes the continuations parked by Job_Run_After() and pushes them, so a Job_Run_After() racing with it either parks its jobs before the counter reaches zero or sees zero and pushes them itself.
+*/
+static void Job_Counter_Decrement(Job_System* job_system, Job_Counter* counter)
+{
+      for(;;) {
+	    LONG value = counter->value;
+	    if(value <= 1) {
+		  break;
+	    }
+	    if(InterlockedCompareExchange(&counter->value, value - 1, value) == value) {
+		  return;
+	    }
+      }
+
+      Job continuations[JOB_MAX_CONTINUATIONS];
+      int continuation_count = 0;
+      AcquireSRWLockExclusive(&counter->lock);
+      if(InterlockedDecrement(&counter->value) == 0) {
+	    continuation_count = counter->continuation_count;
+	    memcpy(continuations, counter->continuations, sizeof(Job) * continuation_count);
+	    counter->continuation_count = 0;
+      }
+      ReleaseSRWLockExclusive(&counter->lock);
+
+      Job_Push(job_system, continuations, continuation_count);
+}
+
+
+
+/* Thread procedure for every worker other than worker 0. It spins for a while when it runs out of work, and then sleeps on the wake semaphore until Job_Push() or Job_System_Shutdown() signals it.
+*/
+static DWORD WINAPI Job_Worker_Thread(LPVOID param)
+{
+      Job_Worker* self = (Job_Worker *)param;
+      Job_System* job_system = self->system;
+      job_current_worker = self;
+
+      int idle_count = 0;
+      Job job;
+      while(job_system->running) {
+	    if(Job_Find(job_system, self, &job)) {
+		  Job_Execute(self, &job);
+		  idle_count = 0;
+		  continue;
+	    }
+
+	    idle_count += 1;
+	    if(idle_count < JOB_IDLE_SPIN_COUNT) {
+		  YieldProcessor();
+		  continue;
+	    }
+
+	    /* we announce that we are going to sleep before looking for work one last time, so a Job_Push() after this check is guaranteed to see us and release the semaphore */
+	    InterlockedIncrement(&job_system->sleeping_count);
+	    if(Job_Find(job_system, self, &job)) {
+		  InterlockedDecrement(&job_system->sleeping_count);
+		  Job_Execute(self, &job);
+		  idle_count = 0;
+		  continue;
+	    }
+
+	    self->stats.sleeps += 1;
+	    WaitForSingleObject(job_system->wake_semaphore, INFINITE);
+	    InterlockedDecrement(&job_system->sleeping_count);
+	    idle_count = 0;
+      }
+
+
+      return 0;
+}
+
+
+
+/* Submits "job_count" jobs, overwriting each job's counter with "counter" (which can be NULL) and incrementing it once per job. Jobs go onto the calling worker's deque, see Job_Push().
+*/
+static void Job_Run(Job_System* job_system, const Job* jobs, int job_count, Job_Counter* counter)
+{
+      Job_Run_After(job_system, jobs, job_count, counter, NULL);
+}
+
+
+
+/* Job_Run() for jobs that depend on the jobs of "dependency" (which can be NULL). "counter" is incremented right away, so waiting on it also covers jobs that haven't been pushed yet, but the jobs themselves are only pushed once "dependency" reaches zero, by whichever job brings it there. No worker ever blocks on the dependency.
+*/
+static void Job_Run_After(Job_System* job_system, const Job* jobs, int job_count, Job_Counter* counter, Job_Counter* dependency)
+{
+      if(job_count <= 0) {
+	    return;
+      }
+      if(counter != NULL) {
+	    InterlockedExchangeAdd(&counter->value, job_count);
+      }
+
+      if(dependency != NULL) {
+	    AcquireSRWLockExclusive(&dependency->lock);
+	    if(dependency->value > 0) {
+		  if(dependency->continuation_count + job_count <= JOB_MAX_CONTINUATIONS) {
+			for(int i = 0; i < job_count; ++i) {
+			      Job* continuation = &dependency->continuations[dependency->continuation_count++];
+			      *continuation = jobs[i];
+			      continuation->counter = counter;
+			}
+			ReleaseSRWLockExclusive(&dependency->lock);
+			return;
+		  }
+
+		  /* out of continuation slots, which only costs us the overlap: we help out until the dependency is done and push the jobs ourselves */
+		  ReleaseSRWLockExclusive(&dependency->lock);
+		  Job_Wait(job_system, dependency);
+	    } else {
+		  ReleaseSRWLockExclusive(&dependency->lock);
+	    }
+      }
+
+      for(int i = 0; i < job_count; i += JOB_MAX_CONTINUATIONS) {
+	    Job batch[JOB_MAX_CONTINUATIONS];
+	    int batch_count = job_count - i < JOB_MAX_CONTINUATIONS ? job_count - i : JOB_MAX_CONTINUATIONS;
+	    for(int k = 0; k < batch_count; ++k) {
+		  batch[k] = jobs[i + k];
+		  batch[k].counter = counter;
+	    }
+	    Job_Push(job_system, batch, batch_count);
+      }
+}
+
+
+
+/* Blocks until "counter" reaches zero. Workers execute other jobs while they wait instead of blocking, which is what makes it safe for a job to wait on jobs it submitted itself.
+*/
+static void Job_Wait(Job_System* job_system, Job_Counter* counter)
+{
+      Job_Worker* self = job_current_worker;
+      if(self != NULL && self->system != job_system) {
+	    self = NULL;
+      }
+
+      Job job;
+      while(counter->value > 0) {
+	    if(self != NULL && Job_Find(job_system, self, &job)) {
+		  Job_Execute(self, &job);
+	    } else {
+		  YieldProcessor();
+	    }
+      }
+
+      /* the job that brought the counter to zero can still be holding its lock, and the caller is free to reuse or drop the counter once we return */
+      AcquireSRWLockExclusive(&counter->lock);
+      ReleaseSRWLockExclusive(&counter->lock);
+}
+
+
+
+static void Job_Parallel_For_Batch_Job(void* data)
+{
+      Job_Parallel_For_Batch* batch = (Job_Parallel_For_Batch *)data;
+      batch->func(batch->data, batch->begin, batch->end);
+}
+
+
+
+/* Calls "func" over the range [0, count) split into batches of at least "min_batch_size", spread over the job system, and returns once every batch has finished. The range is cut into about four batches per worker so that stealing can even out uneven batches.
+*/
+static void Job_Parallel_For(Job_System* job_system, int count, int min_batch_size, Job_Range_Func func, void* data)
+{
+      if(count <= 0) {
+	    return;
+      }
+      if(min_batch_size < 1) {
+	    min_batch_size = 1;
+      }
+
+      int target_batch_count = job_system->worker_count * 4;
+      int batch_size = (count + target_batch_count - 1) / target_batch_count;
+      if(batch_size < min_batch_size) {
+	    batch_size = min_batch_size;
+      }
+      int batch_count = (count + batch_size - 1) / batch_size;
+      if(batch_count > JOB_PARALLEL_FOR_MAX_BATCHES) {
+	    batch_count = JOB_PARALLEL_FOR_MAX_BATCHES;
+	    batch_size = (count + batch_count - 1) / batch_count;
+	    batch_count = (count + batch_size - 1) / batch_size;
+      }
+      if(batch_count == 1) {
+	    func(data, 0, count);
+	    return;
+      }
+
+      /* the batches can live on the stack because we don't return until they are all done */
+      Job_Parallel_For_Batch batches[JOB_PARALLEL_FOR_MAX_BATCHES];
+      Job jobs[JOB_PARALLEL_FOR_MAX_BATCHES];
+      for(int i = 0; i < batch_count; ++i) {
+	    batches[i].func = func;
+	    batches[i].data = data;
+	    batches[i].begin = i * batch_size;
+	    batches[i].end = (i + 1) * batch_size < count ? (i + 1) * batch_size : count;
+	    jobs[i].func = Job_Parallel_For_Batch_Job;
+	    jobs[i].data = &batches[i];
+	    jobs[i].counter = NULL;
+      }
+
+      Job_Counter counter = {0};
+      Job_Run(job_system, jobs, batch_count, &counter);
+      Job_Wait(job_system, &counter);
+}
+
+
+
+/* Sums the stats of every worker into "total_stats". The stats are read without synchronisation, so they're only exact once the workers are idle.
+*/
+static void Job_System_Get_Stats(Job_System* job_system, Job_Worker_Stats* total_stats)
+{
+      memset(total_stats, 0, sizeof(Job_Worker_Stats));
+      for(int i = 0; i < job_system->worker_count; ++i) {
+	    Job_Worker_Stats* stats = &job_system->workers[i].stats;
+	    total_stats->jobs_executed += stats->jobs_executed;
+	    total_stats->steal_attempts += stats->steal_attempts;
+	    total_stats->steals += stats->steals;
+	    total_stats->steal_contention += stats->steal_contention;
+	    total_stats->pop_contention += stats->pop_contention;
+	    total_stats->sleeps += stats->sleeps;
+      }
+}
+
+
+
+static void Job_System_Print_Stats(Job_System* job_system)
+{
+      Job_Worker_Stats total;
+      Job_System_Get_Stats(job_system, &total);
+      LOG_INFO("JOB SYSTEM: %d workers, %lld jobs executed, %lld/%lld steals succeeded, %lld steals lost to contention, %lld pops lost to contention, %lld sleeps\n",
+	     job_system->worker_count,
+	     (long long)total.jobs_executed,
+	     (long long)total.steals,
+	     (long long)total.steal_attempts,
+	     (long long)total.steal_contention,
+	     (long long)total.pop_contention,
+	     (long long)total.sleeps);
+}
+
+
+
+#if JOB_SYSTEM_BENCHMARK
+#define JOB_BENCHMARK_VALUE_COUNT (1 << 20)
+#define JOB_BENCHMARK_REPEATS 64
+
+/* a bit of ALU work per element, so that the benchmark measures scaling of the job system and not just memory bandwidth */
+static void Job_Benchmark_Range(void* data, int begin, int end)
+{
+      float* values = (float *)data;
+      for(int i = begin; i < end; ++i) {
+	    float v = values[i];
+	    for(int j = 0; j < 16; ++j) {
+		  v = sqrtf(v * 1.0001f + 1.0f);
+	    }
+	    values[i] = v;
+      }
+}
+
+
+
+/* Runs the same parallel-for workload with 1..N worker threads (N being the number of logical processors) and prints the time per run, the speedup and efficiency against a single thread, and the contention stats for each thread count.
+*/
+static void Job_System_Benchmark(void)
+{
+      SYSTEM_INFO system_info;
+      GetSystemInfo(&system_info);
+      int max_workers = (int)system_info.dwNumberOfProcessors;
+      if(max_workers > JOB_MAX_WORKERS) {
+	    max_workers = JOB_MAX_WORKERS;
+      }
+
+      float* values = (float *)VirtualAlloc(NULL, sizeof(float) * JOB_BENCHMARK_VALUE_COUNT, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+      if(values == NULL) {
+	    LOG_ERROR("VirtualAlloc() failed to allocate the job system benchmark data\n");
+	    return;
+      }
+
+      LARGE_INTEGER frequency;
+      QueryPerformanceFrequency(&frequency);
+
+      LOG_INFO("JOB SYSTEM BENCHMARK: %d values, %d repeats per thread count\n", JOB_BENCHMARK_VALUE_COUNT, JOB_BENCHMARK_REPEATS);
+      double single_thread_ms = 0.0;
+      for(int worker_count = 1; worker_count <= max_workers; ++worker_count) {
+	    Job_System job_system;
+	    if(Job_System_Init(&job_system, worker_count) != 1) {
+		  LOG_ERROR("Job_System_Init() failed with %d workers\n", worker_count);
+		  break;
+	    }
+
+	    for(int i = 0; i < JOB_BENCHMARK_VALUE_COUNT; ++i) {
+		  values[i] = (float)i;
+	    }
+	    Job_Parallel_For(&job_system, JOB_BENCHMARK_VALUE_COUNT, 1024, Job_Benchmark_Range, values); /* warm up, wakes the workers */
+
+	    LARGE_INTEGER start;
+	    LARGE_INTEGER end;
+	    QueryPerformanceCounter(&start);
+	    for(int repeat = 0; repeat < JOB_BENCHMARK_REPEATS; ++repeat) {
+		  Job_Parallel_For(&job_system, JOB_BENCHMARK_VALUE_COUNT, 1024, Job_Benchmark_Range, values);
+	    }
+	    QueryPerformanceCounter(&end);
+
+	    double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart / JOB_BENCHMARK_REPEATS;
+	    if(worker_count == 1) {
+		  single_thread_ms = ms;
+	    }
+	    double speedup = single_thread_ms / ms;
+	    LOG_INFO("  %2d threads: %8.3f ms/run, speedup %5.2fx, efficiency %5.1f%%\n", worker_count, ms, speedup, 100.0 * speedup / worker_count);
+	    Job_System_Print_Stats(&job_system);
+
+	    Job_System_Shutdown(&job_system);
+      }
+
+      VirtualFree(values, 0, MEM_RELEASE);
+}
+#endif
+
+
+
+
+/* Records an input message for the frame jobs to process. Only called from WindowProc() on the main thread. Events past the end of the queue are dropped (and counted), which only happens if far more than a frame's worth of input arrives at once.
+*/
+static void Input_Event_Push(HWND window_handle, UINT message, WPARAM wParam, LPARAM lParam)
+{
+      if(input_event_queue.count >= INPUT_EVENT_QUEUE_LENGTH) {
+	    input_event_queue.dropped_count += 1;
+	    return;
+      }
+
+      Input_Event* event = &input_event_queue.events[input_event_queue.count];
+      event->window = Window_Set_Find(&window_set, window_handle);
+      event->message = message;
+      event->wParam = wParam;
+      event->lParam = lParam;
+      input_event_queue.count += 1;
+
+      Render_Invalidate(&render_scheduler, RENDER_INVALIDATE_INPUT);
+}
+
+
+
+/* Frame job: folds the input events recorded during this frame's message pump into the frame's input state. */
+static void Frame_Process_Input_Job(void* data)
+{
+      Frame_State* frame = (Frame_State *)data;
+      Input_State* input = &frame->input;
+
+      input->mouse_wheel = 0;
+      for(int i = 0; i < input_event_queue.count; ++i) {
+	    Input_Event* event = &input_event_queue.events[i];
+	    switch(event->message) {
+	    case WM_MOUSEMOVE: {
+		  input->mouse_window = event->window;
+		  input->mouse_x = GET_X_LPARAM(event->lParam);
+		  input->mouse_y = GET_Y_LPARAM(event->lParam);
+	    } break;
+	    case WM_MOUSEWHEEL: {
+		  input->mouse_wheel += GET_WHEEL_DELTA_WPARAM(event->wParam);
+	    } break;
+	    case WM_LBUTTONDOWN: { input->mouse_buttons |= 1u << 0; } break;
+	    case WM_LBUTTONUP: { input->mouse_buttons &= ~(1u << 0); } break;
+	    case WM_MBUTTONDOWN: { input->mouse_buttons |= 1u << 1; } break;
+	    case WM_MBUTTONUP: { input->mouse_buttons &= ~(1u << 1); } break;
+	    case WM_RBUTTONDOWN: { input->mouse_buttons |= 1u << 2; } break;
+	    case WM_RBUTTONUP: { input->mouse_buttons &= ~(1u << 2); } break;
+	    case WM_XBUTTONDOWN: {
+		  input->mouse_buttons |= (GET_XBUTTON_WPARAM(event->wParam) == XBUTTON1) ? (1u << 3) : (1u << 4);
+	    } break;
+	    case WM_XBUTTONUP: {
+		  input->mouse_buttons &= ~((GET_XBUTTON_WPARAM(event->wParam) == XBUTTON1) ? (1u << 3) : (1u << 4));
+	    } break;
+	    case WM_KEYDOWN:
+	    case WM_SYSKEYDOWN: {
+		  input->keys_down[event->wParam & 0xFF] = 1;
+		  if(event->wParam == VK_SPACE && (event->lParam & (1 << 30)) == 0) { /* bit 30 is set for auto-repeats */
+			Simulation_Set_Paused(frame->simulation, !frame->simulation->paused);
+		  }
+	    } break;
+	    case WM_KEYUP:
+	    case WM_SYSKEYUP: {
+		  input->keys_down[event->wParam & 0xFF] = 0;
+	    } break;
+	    default: {
+	    } break;
+	    }
+      }
+
+      input_event_queue.count = 0;
+}
+
+
+
+/* Frame job: advances the frame clock, and picks up the newest simulation snapshot and interpolates it to the frame's time. The simulation itself runs on its own thread, so this never waits for a tick. It is only pushed once the input job has finished, since this is where the frame's input would be handed to the simulation. */
+static void Frame_Simulate_Job(void* data)
+{
+      Frame_State* frame = (Frame_State *)data;
+
+      LARGE_INTEGER counter;
+      QueryPerformanceCounter(&counter);
+      frame->delta_time = (double)(counter.QuadPart - frame->last_counter) / (double)frame->counter_frequency;
+      frame->last_counter = counter.QuadPart;
+      frame->time += frame->delta_time;
+      frame->frame_index += 1;
+
+      const Simulation_Snapshot* snapshot = Simulation_Acquire_Snapshot(frame->simulation);
+      Simulation_Interpolate(frame->simulation, snapshot, counter.QuadPart, &frame->simulation_state);
+      frame->animating = !frame->simulation->paused && frame->simulation_state.triangle_angular_velocity != 0.0f;
+
+      /* while the angle holds still (paused, or stopped) these leave the nodes clean, and the scene update has nothing to do */
+      Scene_Set_Rotation_Z(frame->scene, frame->scene_root, frame->simulation_state.triangle_angle);
+      for(int i = 0; i < 2; ++i) {
+	    Scene_Set_Rotation_Z(frame->scene, frame->scene_moons[i], frame->simulation_state.triangle_angle * -3.0f);
+      }
+}
+
+
+
+/* Frame job: brings the scene's world matrices up to date, and builds the list of draws for the render loop to submit from the scene's drawable nodes. It is only pushed once the simulation job has finished, since that decides what gets drawn. */
+static void Frame_Prepare_Draw_Job(void* data)
+{
+      Frame_State* frame = (Frame_State *)data;
+
+      Scene* scene = frame->scene;
+      Scene_Update_World(scene, frame->job_system);
+
+      frame->draw_cmd_count = 0;
+      for(int i = 0; i < scene->node_count && frame->draw_cmd_count < FRAME_MAX_DRAW_CMDS; ++i) {
+	    if(scene->draw_counts[i] == 0) {
+		  continue;
+	    }
+	    Draw_Cmd* cmd = &frame->draw_cmds[frame->draw_cmd_count++];
+	    cmd->program = frame->shader_program;
+	    cmd->vao = scene->draw_vaos[i];
+	    cmd->first = 0;
+	    cmd->count = scene->draw_counts[i];
+	    cmd->model_location = frame->model_location;
+	    memcpy(cmd->model, &scene->world_matrices[i * 16], sizeof(cmd->model));
+      }
+}
+
+
+
+/* Frame job: sets up this frame's particle step, for the render loop to submit. It runs beside Frame_Prepare_Draw_Job(), both only need what the simulation job decided. */
+static void Frame_Prepare_Particles_Job(void* data)
+{
+      Frame_State* frame = (Frame_State *)data;
+
+      frame->particles_stepping = frame->particles != NULL && frame->animating; /* the particles pause along with the simulation */
+      if(frame->particles_stepping) {
+	    Particle_System_Prepare(frame->particles, (float)frame->delta_time);
+      }
+}
+
+
+
+
+#if GL_DIAGNOSTICS
+static const char* GL_Debug_Source_String(GLenum source)
+{
+      switch(source) {
+      case GL_DEBUG_SOURCE_API: return "API";
+      case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "WINDOW_SYSTEM";
+      case GL_DEBUG_SOURCE_SHADER_COMPILER: return "SHADER_COMPILER";
+      case GL_DEBUG_SOURCE_THIRD_PARTY: return "THIRD_PARTY";
+      case GL_DEBUG_SOURCE_APPLICATION: return "APPLICATION";
+      default: return "OTHER";
+      }
+}
+
+
+
+static const char* GL_Debug_Type_String(GLenum type)
+{
+      switch(type) {
+      case GL_DEBUG_TYPE_ERROR: return "ERROR";
+      case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "DEPRECATED_BEHAVIOR";
+      case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "UNDEFINED_BEHAVIOR";
+      case GL_DEBUG_TYPE_PORTABILITY: return "PORTABILITY";
+      case GL_DEBUG_TYPE_PERFORMANCE: return "PERFORMANCE";
+      case GL_DEBUG_TYPE_MARKER: return "MARKER";
+      case GL_DEBUG_TYPE_PUSH_GROUP: return "PUSH_GROUP";
+      case GL_DEBUG_TYPE_POP_GROUP: return "POP_GROUP";
+      default: return "OTHER";
+      }
+}
+
+
+
+static const char* GL_Debug_Severity_String(GLenum severity)
+{
+      switch(severity) {
+      case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
+      case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
+      case GL_DEBUG_SEVERITY_LOW: return "LOW";
+      case GL_DEBUG_SEVERITY_NOTIFICATION: return "NOTIFICATION";
+      default: return "UNKNOWN";
+      }
+}
+
+
+
+/* Enables KHR_debug output for the current context and installs GL_Debug_Message_Callback(). Returns 1 on success, otherwise 0.
+*/
+static int GL_Diagnostics_Init(PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback, PFNGLDEBUGMESSAGECONTROLPROC glDebugMessageControl)
+{
+      memset(&gl_diagnostics, 0, sizeof(GL_Diagnostics));
+      InitializeSRWLock(&gl_diagnostics.lock);
+
+      glEnable(GL_DEBUG_OUTPUT);
+      glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS); /* messages arrive on the thread (and inside the call) that caused them, which is what you want when you put a breakpoint in the callback */
+      glDebugMessageCallback(GL_Debug_Message_Callback, NULL);
+      glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE); /* every source, type, and severity */
+
+      if(glGetError() != GL_NO_ERROR) {
+	    glDisable(GL_DEBUG_OUTPUT);
+	    return 0;
+      }
+      gl_diagnostics.debug_output_enabled = 1;
+
+
+      return 1;
+}
+
+
+
+/* KHR_debug message callback. Only the first message for each (source, type, id, severity) is printed, every message is counted. */
+static void APIENTRY GL_Debug_Message_Callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user_param)
+{
+      if(type == GL_DEBUG_TYPE_PERFORMANCE) {
+	    InterlockedIncrement(&gl_diagnostics.frame_performance_count);
+      } else if(type == GL_DEBUG_TYPE_ERROR) {
+	    InterlockedIncrement(&gl_diagnostics.frame_error_count);
+      }
+
+      int first_occurrence = 0;
+      unsigned int hash = (id * 2654435761u) ^ (source * 31u) ^ (type * 131u) ^ (severity * 8191u);
+
+      AcquireSRWLockExclusive(&gl_diagnostics.lock);
+      GL_Debug_Message_Entry* entry = NULL;
+      for(unsigned int probe = 0; probe < GL_DIAGNOSTICS_TABLE_SIZE; ++probe) {
+	    GL_Debug_Message_Entry* candidate = &gl_diagnostics.entries[(hash + probe) & (GL_DIAGNOSTICS_TABLE_SIZE - 1)];
+	    if(!candidate->used) {
+		  candidate->used = 1;
+		  candidate->source = source;
+		  candidate->type = type;
+		  candidate->id = id;
+		  candidate->severity = severity;
+		  if(length < 0) {
+			length = (GLsizei)strlen(message);
+		  }
+		  if(length >= GL_DIAGNOSTICS_MESSAGE_LENGTH) {
+			length = GL_DIAGNOSTICS_MESSAGE_LENGTH - 1;
+		  }
+		  memcpy(candidate->message, message, (size_t)length);
+		  candidate->message[length] = '\0';
+		  gl_diagnostics.entry_count += 1;
+		  first_occurrence = 1;
+		  entry = candidate;
+		  break;
+	    }
+	    if(candidate->id == id && candidate->source == source && candidate->type == type && candidate->severity == severity) {
+		  entry = candidate;
+		  break;
+	    }
+      }
+      if(entry != NULL) {
+	    entry->count += 1;
+      } else {
+	    gl_diagnostics.dropped_count += 1;
+      }
+      ReleaseSRWLockExclusive(&gl_diagnostics.lock);
+
+      if(first_occurrence) {
+	    /* the log level follows the message severity, the level of a LOG_*() call site is fixed at compile time so we need one call per level */
+	    if(severity == GL_DEBUG_SEVERITY_HIGH) {
+		  LOG_ERROR("GL DEBUG [%s] [%s] [%s] id %u: %s\n", GL_Debug_Severity_String(severity), GL_Debug_Type_String(type), GL_Debug_Source_String(source), id, message);
+	    } else if(severity == GL_DEBUG_SEVERITY_NOTIFICATION) {
+		  LOG_DEBUG("GL DEBUG [%s] [%s] [%s] id %u: %s\n", GL_Debug_Severity_String(severity), GL_Debug_Type_String(type), GL_Debug_Source_String(source), id, message);
+	    } else {
+		  LOG_WARN("GL DEBUG [%s] [%s] [%s] id %u: %s\n", GL_Debug_Severity_String(severity), GL_Debug_Type_String(type), GL_Debug_Source_String(source), id, message);
+	    }
+      }
+}
+
+
+
+/* Call once per frame after the swap. Drains glGetError() (which is the only error reporting we get when debug output isn't enabled), resets the per-frame counters, and returns the number of GL_DEBUG_TYPE_PERFORMANCE messages raised during the frame.
+*/
+static LONG GL_Diagnostics_End_Frame(void)
+{
+      GLenum error = glGetError();
+      while(error != GL_NO_ERROR) {
+	    if(!gl_diagnostics.debug_output_enabled) {
+		  LOG_ERROR("GL ERROR: glGetError() returned 0x%04X\n", error);
+		  InterlockedIncrement(&gl_diagnostics.frame_error_count);
+	    }
+	    error = glGetError();
+      }
+
+      LONG performance_count = InterlockedExchange(&gl_diagnostics.frame_performance_count, 0);
+      LONG error_count = InterlockedExchange(&gl_diagnostics.frame_error_count, 0);
+      gl_diagnostics.last_frame_performance_count = performance_count;
+      gl_diagnostics.total_performance_count += performance_count;
+      gl_diagnostics.total_error_count += error_count;
+
+
+      return performance_count;
+}
+
+
+
+/* Prints every distinct GL debug message we got along with how many times it was raised. */
+static void GL_Diagnostics_Print_Summary(void)
+{
+      LOG_INFO("GL DIAGNOSTICS: %d distinct messages, %lld errors, %lld performance warnings, %lld messages not tracked (table full)\n",
+	     gl_diagnostics.entry_count,
+	     (long long)gl_diagnostics.total_error_count,
+	     (long long)gl_diagnostics.total_performance_count,
+	     (long long)gl_diagnostics.dropped_count);
+
+      AcquireSRWLockExclusive(&gl_diagnostics.lock);
+      for(int i = 0; i < GL_DIAGNOSTICS_TABLE_SIZE; ++i) {
+	    GL_Debug_Message_Entry* entry = &gl_diagnostics.entries[i];
+	    if(!entry->used) {
+		  continue;
+	    }
+	    LOG_INFO("  %8lld x [%s] [%s] [%s] id %u: %s\n",
+		   (long long)entry->count,
+		   GL_Debug_Severity_String(entry->severity),
+		   GL_Debug_Type_String(entry->type),
+		   GL_Debug_Source_String(entry->source),
+		   entry->id,
+		   entry->message);
+      }
+      ReleaseSRWLockExclusive(&gl_diagnostics.lock);
+}
+#endif
+
+
+
+
+static void Benchmark_Add_Metric(Benchmark_Results* results, const char* scenario, const char* name, double value, int higher_is_better)
+{
+      if(results->metric_count >= BENCHMARK_MAX_METRICS) {
+	    LOG_WARN("too many benchmark metrics, dropping %s.%s\n", scenario, name);
+	    return;
+      }
+
+      if(!isfinite(value)) {
+	    LOG_WARN("benchmark metric %s.%s is not finite (probably measured 0 time), recording it as 0\n", scenario, name);
+	    value = 0.0;
+      }
+
+      Benchmark_Metric* metric = &results->metrics[results->metric_count++];
+      metric->scenario = scenario;
+      metric->name = name;
+      metric->value = value;
+      metric->higher_is_better = higher_is_better;
+      LOG_INFO("BENCHMARK: %s.%s = %.3f\n", scenario, name, value);
+}
+
+
+
+static double Benchmark_Elapsed_Seconds(Benchmark_Results* results, LARGE_INTEGER start, LARGE_INTEGER end)
+{
+      return (double)(end.QuadPart - start.QuadPart) / (double)results->counter_frequency;
+}
+
+
+
+/* Scenario "extension_lookup": the cost of Check_Extension_Available() against the real WGL extension string (for extensions near the front, near the back, and missing), and of loading GL procedures with Load_WGL_Proc(). */
+static void Benchmark_Extension_Lookup(Benchmark_Results* results, const char* extensions_string)
+{
+      const char* extension_names[] = {
+	    "WGL_ARB_pixel_format",
+	    "WGL_ARB_create_context_profile",
+	    "WGL_EXT_swap_control",
+	    "WGL_EXT_swap_control_tear",
+	    "WGL_NOT_A_REAL_extension"
+      };
+      const char* proc_names[] = {
+	    "glGetStringi", "glGenBuffers", "glBindBuffer", "glBufferData", "glBufferSubData",
+	    "glCreateShader", "glShaderSource", "glCompileShader", "glCreateProgram", "glAttachShader",
+	    "glLinkProgram", "glDeleteShader", "glUseProgram", "glVertexAttribPointer", "glEnableVertexAttribArray",
+	    "glGenVertexArrays", "glBindVertexArray", "glGetShaderiv", "glGetShaderInfoLog", "glGetProgramiv"
+      };
+      int extension_name_count = (int)(sizeof(extension_names) / sizeof(extension_names[0]));
+      int proc_name_count = (int)(sizeof(proc_names) / sizeof(proc_names[0]));
+      int iterations = 10000;
+
+      volatile int found_count = 0; /* keeps the lookups from being optimised away */
+      LARGE_INTEGER start;
+      LARGE_INTEGER end;
+      QueryPerformanceCounter(&start);
+      for(int i = 0; i < iterations; ++i) {
+	    for(int j = 0; j < extension_name_count; ++j) {
+		  found_count += Check_Extension_Available(extensions_string, extension_names[j]);
+	    }
+      }
+      QueryPerformanceCounter(&end);
+      Benchmark_Add_Metric(results, "extension_lookup", "lookup_ns", Benchmark_Elapsed_Seconds(results, start, end) * 1e9 / ((double)iterations * extension_name_count), 0);
+
+      iterations = 200;
+      volatile int loaded_count = 0;
+      QueryPerformanceCounter(&start);
+      for(int i = 0; i < iterations; ++i) {
+	    for(int j = 0; j < proc_name_count; ++j) {
+		  loaded_count += (Load_WGL_Proc(proc_names[j]) != NULL);
+	    }
+      }
+      QueryPerformanceCounter(&end);
+      Benchmark_Add_Metric(results, "extension_lookup", "proc_load_ns", Benchmark_Elapsed_Seconds(results, start, end) * 1e9 / ((double)iterations * proc_name_count), 0);
+}
+
+
+
+/* Scenario "input_dispatch": the cost of one input message going through SendMessageA() and WindowProc(), including the logging and input event recording it does. */
+static void Benchmark_Input_Dispatch(Benchmark_Results* results, HWND window_handle)
+{
+      UINT messages[] = { WM_MOUSEMOVE, WM_LBUTTONDOWN, WM_LBUTTONUP, WM_KEYDOWN, WM_KEYUP };
+      int message_count = (int)(sizeof(messages) / sizeof(messages[0]));
+      int iterations = 20000;
+
+      LARGE_INTEGER start;
+      LARGE_INTEGER end;
+      QueryPerformanceCounter(&start);
+      for(int i = 0; i < iterations; ++i) {
+	    UINT message = messages[i % message_count];
+	    WPARAM wParam = (message == WM_KEYDOWN || message == WM_KEYUP) ? 'A' : 0;
+	    LPARAM lParam = (LPARAM)(((i & 0xFF) << 16) | (i & 0xFF));
+	    SendMessageA(window_handle, message, wParam, lParam);
+	    if(input_event_queue.count >= INPUT_EVENT_QUEUE_LENGTH) {
+		  input_event_queue.count = 0; /* stands in for the input job consuming the events */
+	    }
+      }
+      QueryPerformanceCounter(&end);
+      input_event_queue.count = 0;
+      input_event_queue.dropped_count = 0;
+
+      Benchmark_Add_Metric(results, "input_dispatch", "ns_per_message", Benchmark_Elapsed_Seconds(results, start, end) * 1e9 / (double)iterations, 0);
+}
+
+
+
+/* Scenario "draw_submission": draws the same set of tiny triangles (so fill rate doesn't matter) with an increasing number of triangles per glDrawArrays() call, and reports triangles/s and draws/s for each batch size. */
+static void Benchmark_Draw_Submission(Benchmark_Results* results, GLuint shader_program)
+{
+#define BENCHMARK_DRAW_TRIANGLES 65536
+      static const int batch_sizes[] = { 1, 16, 256, 4096, 65536 };
+      static const char* triangle_metric_names[] = { "triangles_per_s_batch_1", "triangles_per_s_batch_16", "triangles_per_s_batch_256", "triangles_per_s_batch_4096", "triangles_per_s_batch_65536" };
+      static const char* draw_metric_names[] = { "draws_per_s_batch_1", "draws_per_s_batch_16", "draws_per_s_batch_256", "draws_per_s_batch_4096", "draws_per_s_batch_65536" };
+      int batch_size_count = (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0]));
+      int repeats = 4;
+
+      GLfloat* vertices = (GLfloat *)malloc(sizeof(GLfloat) * 9 * BENCHMARK_DRAW_TRIANGLES);
+      if(vertices == NULL) {
+	    LOG_ERROR("failed to allocate the draw submission benchmark vertices\n");
+	    return;
+      }
+      unsigned int random_state = 12345u;
+      for(int i = 0; i < BENCHMARK_DRAW_TRIANGLES; ++i) {
+	    random_state = random_state * 1664525u + 1013904223u;
+	    float x = (float)(random_state >> 8) / 16777216.0f * 1.8f - 0.9f;
+	    random_state = random_state * 1664525u + 1013904223u;
+	    float y = (float)(random_state >> 8) / 16777216.0f * 1.8f - 0.9f;
+	    GLfloat* triangle = &vertices[i * 9];
+	    triangle[0] = x;          triangle[1] = y;          triangle[2] = 0.0f;
+	    triangle[3] = x + 0.002f; triangle[4] = y;          triangle[5] = 0.0f;
+	    triangle[6] = x;          triangle[7] = y + 0.002f; triangle[8] = 0.0f;
+      }
+
+      GLuint vao;
+      GLuint vbo;
+      glGenVertexArrays(1, &vao);
+      glGenBuffers(1, &vbo);
+      glBindVertexArray(vao);
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 9 * BENCHMARK_DRAW_TRIANGLES, (const void *)vertices, GL_STATIC_DRAW);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *)0);
+      glEnableVertexAttribArray(0);
+      glUseProgram(shader_program);
+      free(vertices);
+
+      GLfloat identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f };
+      glUniformMatrix4fv(glGetUniformLocation(shader_program, "model"), 1, GL_FALSE, identity);
+
+      for(int b = 0; b < batch_size_count; ++b) {
+	    int batch_size = batch_sizes[b];
+	    LARGE_INTEGER start;
+	    LARGE_INTEGER end;
+	    for(int repeat = -1; repeat < repeats; ++repeat) { /* repeat -1 is a warm up pass */
+		  if(repeat == 0) {
+			glFinish();
+			QueryPerformanceCounter(&start);
+		  }
+		  for(int first = 0; first < BENCHMARK_DRAW_TRIANGLES; first += batch_size) {
+			glDrawArrays(GL_TRIANGLES, first * 3, batch_size * 3);
+		  }
+	    }
+	    glFinish();
+	    QueryPerformanceCounter(&end);
+
+	    double seconds = Benchmark_Elapsed_Seconds(results, start, end);
+	    double triangle_count = (double)BENCHMARK_DRAW_TRIANGLES * repeats;
+	    double draw_count = triangle_count / batch_size;
+	    Benchmark_Add_Metric(results, "draw_submission", triangle_metric_names[b], triangle_count / seconds, 1);
+	    Benchmark_Add_Metric(results, "draw_submission", draw_metric_names[b], draw_count / seconds, 1);
+      }
+
+      glBindVertexArray(0);
+      glDeleteBuffers(1, &vbo);
+      glDeleteVertexArrays(1, &vao);
+}
+
+
+
+/* Scenario "buffer_upload": glBufferSubData() bandwidth into a GL_STREAM_DRAW buffer for a range of upload sizes, including the time for the driver to finish the copies. */
+static void Benchmark_Buffer_Upload(Benchmark_Results* results)
+{
+#define BENCHMARK_UPLOAD_BUFFER_SIZE (16 * 1024 * 1024)
+      static const int upload_sizes[] = { 4 * 1024, 64 * 1024, 1024 * 1024, BENCHMARK_UPLOAD_BUFFER_SIZE };
+      static const char* metric_names[] = { "mb_per_s_4kb", "mb_per_s_64kb", "mb_per_s_1mb", "mb_per_s_16mb" };
+      int upload_size_count = (int)(sizeof(upload_sizes) / sizeof(upload_sizes[0]));
+
+      unsigned char* data = (unsigned char *)malloc(BENCHMARK_UPLOAD_BUFFER_SIZE);
+      if(data == NULL) {
+	    LOG_ERROR("failed to allocate the buffer upload benchmark data\n");
+	    return;
+      }
+      memset(data, 0x5A, BENCHMARK_UPLOAD_BUFFER_SIZE);
+
+      GLuint buffer;
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      glBufferData(GL_ARRAY_BUFFER, BENCHMARK_UPLOAD_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+
+      for(int u = 0; u < upload_size_count; ++u) {
+	    int upload_size = upload_sizes[u];
+	    int repeats = (256 * 1024 * 1024) / upload_size; /* 256MB in total for every size */
+	    if(repeats > 8192) {
+		  repeats = 8192;
+	    }
+
+	    glFinish();
+	    LARGE_INTEGER start;
+	    LARGE_INTEGER end;
+	    QueryPerformanceCounter(&start);
+	    for(int repeat = 0; repeat < repeats; ++repeat) {
+		  GLintptr offset = ((GLintptr)repeat * upload_size) % BENCHMARK_UPLOAD_BUFFER_SIZE;
+		  glBufferSubData(GL_ARRAY_BUFFER, offset, upload_size, data);
+	    }
+	    glFinish();
+	    QueryPerformanceCounter(&end);
+
+	    double megabytes = (double)upload_size * repeats / (1024.0 * 1024.0);
+	    Benchmark_Add_Metric(results, "buffer_upload", metric_names[u], megabytes / Benchmark_Elapsed_Seconds(results, start, end), 1);
+      }
+
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glDeleteBuffers(1, &buffer);
+      free(data);
+}
+
+
+
+/* Scenario "gpu_pool": a frame's worth of transient buffers, textures and render targets, created and deleted every frame versus taken from and given back to a Gpu_Pool. The pool's budget is smaller than the working set, so the pooled numbers include evictions. */
+static void Benchmark_Gpu_Pool(Benchmark_Results* results)
+{
+#define BENCHMARK_POOL_FRAMES 200
+#define BENCHMARK_POOL_BUFFERS_PER_FRAME 64
+#define BENCHMARK_POOL_TARGETS_PER_FRAME 4
+#define BENCHMARK_POOL_TEXTURES_PER_FRAME 16
+      static const GLenum target_formats[] = { GL_RGBA8, GL_RGBA16F, GL_DEPTH24_STENCIL8 };
+      static const GLenum texture_formats[] = { GL_RGBA8, GL_R8 };
+      unsigned int random_state = 0x9E3779B9u;
+
+      Gpu_Pool pool;
+      if(Gpu_Pool_Init(&pool, 48 * 1024 * 1024) != 1) {
+	    LOG_ERROR("failed to allocate the GPU pool for the benchmark\n");
+	    return;
+      }
+
+      for(int pooled = 0; pooled < 2; ++pooled) {
+	    glFinish();
+	    LARGE_INTEGER start;
+	    LARGE_INTEGER end;
+	    QueryPerformanceCounter(&start);
+	    for(int frame = 0; frame < BENCHMARK_POOL_FRAMES; ++frame) {
+		  GLuint buffers[BENCHMARK_POOL_BUFFERS_PER_FRAME];
+		  Gpu_Resource* pooled_resources[BENCHMARK_POOL_BUFFERS_PER_FRAME + BENCHMARK_POOL_TARGETS_PER_FRAME + BENCHMARK_POOL_TEXTURES_PER_FRAME];
+		  GLuint targets[BENCHMARK_POOL_TARGETS_PER_FRAME * 2];
+		  GLuint textures[BENCHMARK_POOL_TEXTURES_PER_FRAME];
+		  for(int i = 0; i < BENCHMARK_POOL_BUFFERS_PER_FRAME; ++i) {
+			random_state = random_state * 1664525u + 1013904223u;
+			GLsizeiptr size = (GLsizeiptr)1024 << ((random_state >> 16) % 10); /* 1KB to 512KB */
+			if(pooled) {
+			      pooled_resources[i] = Gpu_Pool_Acquire_Buffer(&pool, size);
+			} else {
+			      glCreateBuffers(1, &buffers[i]);
+			      glNamedBufferStorage(buffers[i], size, NULL, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT);
+			}
+		  }
+		  for(int i = 0; i < BENCHMARK_POOL_TARGETS_PER_FRAME; ++i) {
+			GLenum format = target_formats[(frame + i) % 3];
+			if(pooled) {
+			      pooled_resources[BENCHMARK_POOL_BUFFERS_PER_FRAME + i] = Gpu_Pool_Acquire_Framebuffer(&pool, format, 1024, 1024);
+			} else {
+			      glCreateTextures(GL_TEXTURE_2D, 1, &targets[i * 2]);
+			      glTextureStorage2D(targets[i * 2], 1, format, 1024, 1024);
+			      glCreateFramebuffers(1, &targets[i * 2 + 1]);
+			      glNamedFramebufferTexture(targets[i * 2 + 1], format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_COLOR_ATTACHMENT0, targets[i * 2], 0);
+			}
+		  }
+		  for(int i = 0; i < BENCHMARK_POOL_TEXTURES_PER_FRAME; ++i) {
+			random_state = random_state * 1664525u + 1013904223u;
+			GLenum format = texture_formats[(random_state >> 8) & 1];
+			GLsizei width = 32 + (GLsizei)((random_state >> 12) % 480); /* sprites and glyph pages, not powers of two */
+			GLsizei height = 32 + (GLsizei)((random_state >> 20) % 480);
+			if(pooled) {
+			      pooled_resources[BENCHMARK_POOL_BUFFERS_PER_FRAME + BENCHMARK_POOL_TARGETS_PER_FRAME + i] = Gpu_Pool_Acquire_Texture(&pool, format, width, height);
+			} else {
+			      glCreateTextures(GL_TEXTURE_2D, 1, &textures[i]);
+			      glTextureStorage2D(textures[i], 1, format, width, height);
+			}
+		  }
+
+		  if(pooled) {
+			for(int i = 0; i < BENCHMARK_POOL_BUFFERS_PER_FRAME + BENCHMARK_POOL_TARGETS_PER_FRAME + BENCHMARK_POOL_TEXTURES_PER_FRAME; ++i) {
+			      Gpu_Pool_Release(&pool, pooled_resources[i]);
+			}
+			Gpu_Pool_End_Frame(&pool);
+		  } else {
+			glDeleteBuffers(BENCHMARK_POOL_BUFFERS_PER_FRAME, buffers);
+			glDeleteTextures(BENCHMARK_POOL_TEXTURES_PER_FRAME, textures);
+			for(int i = 0; i < BENCHMARK_POOL_TARGETS_PER_FRAME; ++i) {
+			      glDeleteFramebuffers(1, &targets[i * 2 + 1]);
+			      glDeleteTextures(1, &targets[i * 2]);
+			}
+		  }
+		  glFlush();
+	    }
+	    glFinish();
+	    QueryPerformanceCounter(&end);
+
+	    double us_per_frame = Benchmark_Elapsed_Seconds(results, start, end) * 1e6 / (double)BENCHMARK_POOL_FRAMES;
+	    Benchmark_Add_Metric(results, "gpu_pool", pooled ? "pooled_us_per_frame" : "unpooled_us_per_frame", us_per_frame, 0);
+      }
+
+      Benchmark_Add_Metric(results, "gpu_pool", "hit_rate", pool.stats.acquire_count > 0 ? (double)pool.stats.hit_count / (double)pool.stats.acquire_count : 0.0, 1);
+      Benchmark_Add_Metric(results, "gpu_pool", "peak_mb", (double)pool.stats.peak_bytes / (1024.0 * 1024.0), 0);
+      Benchmark_Add_Metric(results, "gpu_pool", "evictions", (double)pool.stats.eviction_count, 0);
+      Gpu_Pool_Shutdown(&pool);
+}
+
+
+
+/* Scenario "particles": update throughput of the GPU particle system at a million particles, once it has settled at its steady state count. Each update is a frame's emit, simulate, compact and draw command passes, without rendering. */
+static void Benchmark_Particles(Benchmark_Results* results, Gpu_Pool* pool)
+{
+#define BENCHMARK_PARTICLE_COUNT (1024 * 1024)
+#define BENCHMARK_PARTICLE_WARMUP_UPDATES 240 /* longer than PARTICLE_MAX_LIFE at 60 updates per second */
+#define BENCHMARK_PARTICLE_UPDATES 240
+      Particle_System particles;
+      if(Particle_System_Init(&particles, pool, BENCHMARK_PARTICLE_COUNT) != 1) {
+	    LOG_ERROR("failed to set up the particle system for the benchmark\n");
+	    return;
+      }
+
+      for(int i = 0; i < BENCHMARK_PARTICLE_WARMUP_UPDATES; ++i) {
+	    Particle_System_Prepare(&particles, 1.0f / 60.0f);
+	    Particle_System_Update(&particles);
+      }
+      GLuint start_count = Particle_System_Read_Alive_Count(&particles);
+      glFinish();
+
+      LARGE_INTEGER start;
+      LARGE_INTEGER end;
+      QueryPerformanceCounter(&start);
+      for(int i = 0; i < BENCHMARK_PARTICLE_UPDATES; ++i) {
+	    Particle_System_Prepare(&particles, 1.0f / 60.0f);
+	    Particle_System_Update(&particles);
+      }
+      glFinish();
+      QueryPerformanceCounter(&end);
+      GLuint end_count = Particle_System_Read_Alive_Count(&particles);
+
+      double seconds = Benchmark_Elapsed_Seconds(results, start, end);
+      double average_count = ((double)start_count + (double)end_count) * 0.5;
+      Benchmark_Add_Metric(results, "particles", "alive_count", average_count, 1);
+      Benchmark_Add_Metric(results, "particles", "update_ms", seconds * 1000.0 / (double)BENCHMARK_PARTICLE_UPDATES, 0);
+      Benchmark_Add_Metric(results, "particles", "particles_per_s", average_count * (double)BENCHMARK_PARTICLE_UPDATES / seconds, 1);
+      Particle_System_Shutdown(&particles);
+}
+
+
+
+/* Scenario "scene": Scene_Update_World() for 100k nodes with a given fraction of the nodes' local transforms changed before every update, first on the calling thread and then spread over the job system. A changed node also recomputes its whole subtree, so the work grows faster than the fraction. */
+static void Benchmark_Scene(Benchmark_Results* results, Job_System* job_system)
+{
+#define BENCHMARK_SCENE_NODE_COUNT 100000
+#define BENCHMARK_SCENE_MAX_DEPTH 12
+#define BENCHMARK_SCENE_UPDATES 50
+      static const double dirty_fractions[] = { 0.001, 0.01, 0.1, 1.0 };
+      static const char* metric_names[2][4] = {
+	    { "update_us_0_1pct_dirty", "update_us_1pct_dirty", "update_us_10pct_dirty", "update_us_100pct_dirty" },
+	    { "parallel_update_us_0_1pct_dirty", "parallel_update_us_1pct_dirty", "parallel_update_us_10pct_dirty", "parallel_update_us_100pct_dirty" }
+      };
+      int fraction_count = (int)(sizeof(dirty_fractions) / sizeof(dirty_fractions[0]));
+      unsigned int random_state = 0x2545F491u;
+      int edit_index = 0; /* every update sets a new angle, setting the one a node already has wouldn't dirty it */
+
+      Scene scene;
+      if(Scene_Init(&scene, BENCHMARK_SCENE_NODE_COUNT) != 1) {
+	    LOG_ERROR("failed to allocate the scene for the benchmark\n");
+	    return;
+      }
+      int* dirty_nodes = (int *)malloc(sizeof(int) * BENCHMARK_SCENE_NODE_COUNT); /* a permutation of the nodes, its first "dirty_count" entries are the nodes changed by an update */
+      if(dirty_nodes == NULL) {
+	    LOG_ERROR("failed to allocate the dirty node list for the scene benchmark\n");
+	    Scene_Shutdown(&scene);
+	    return;
+      }
+      for(int i = 0; i < BENCHMARK_SCENE_NODE_COUNT; ++i) {
+	    dirty_nodes[i] = i;
+      }
+
+      /* a random tree built depth-first: every new node is a child of some node on the path from the root to the last node, so it always appends */
+      int path[BENCHMARK_SCENE_MAX_DEPTH];
+      int path_length = 0;
+      for(int i = 0; i < BENCHMARK_SCENE_NODE_COUNT; ++i) {
+	    random_state = random_state * 1664525u + 1013904223u;
+	    path_length = path_length == 0 ? 0 : (int)((random_state >> 8) % (unsigned int)(path_length + 1));
+	    if(path_length == BENCHMARK_SCENE_MAX_DEPTH) {
+		  path_length -= 1;
+	    }
+	    int node = Scene_Add_Node(&scene, path_length == 0 ? SCENE_NO_PARENT : path[path_length - 1]);
+	    Scene_Set_Translation(&scene, node, 0.1f, 0.0f, 0.0f);
+	    Scene_Set_Rotation_Z(&scene, node, (float)(random_state >> 16) * 0.0001f);
+	    path[path_length++] = node;
+      }
+      Scene_Update_World(&scene, NULL);
+
+      for(int parallel = 0; parallel < 2; ++parallel) {
+	    for(int f = 0; f < fraction_count; ++f) {
+		  int dirty_count = (int)(dirty_fractions[f] * BENCHMARK_SCENE_NODE_COUNT);
+		  LONGLONG total_counts = 0;
+		  for(int update = 0; update < BENCHMARK_SCENE_UPDATES; ++update) {
+			edit_index += 1;
+			/* partial Fisher-Yates shuffle, so the nodes are distinct and 100% really changes every node */
+			for(int d = 0; d < dirty_count; ++d) {
+			      random_state = random_state * 1664525u + 1013904223u;
+			      int swap_index = d + (int)((random_state >> 8) % (unsigned int)(BENCHMARK_SCENE_NODE_COUNT - d));
+			      int node = dirty_nodes[swap_index];
+			      dirty_nodes[swap_index] = dirty_nodes[d];
+			      dirty_nodes[d] = node;
+			      Scene_Set_Rotation_Z(&scene, node, (float)edit_index * 0.01f);
+			}
+
+			LARGE_INTEGER start;
+			LARGE_INTEGER end;
+			QueryPerformanceCounter(&start);
+			Scene_Update_World(&scene, parallel ? job_system : NULL);
+			QueryPerformanceCounter(&end);
+			total_counts += end.QuadPart - start.QuadPart;
+		  }
+		  Benchmark_Add_Metric(results, "scene", metric_names[parallel][f], (double)total_counts * 1e6 / (double)results->counter_frequency / (double)BENCHMARK_SCENE_UPDATES, 0);
+	    }
+      }
+
+      free(dirty_nodes);
+      Scene_Shutdown(&scene);
+}
+
+
+
+/* Scenario "window_count": frame time with 1 to 4 windows open, all rendered from the one context and swapped together without vsync. Each window is only cleared, so the numbers show the cost of switching drawables and swapping. */
+static void Benchmark_Window_Count(Benchmark_Results* results, Window_Set* set)
+{
+#define BENCHMARK_WINDOW_FRAMES 200
+      static const char* frame_metric_names[] = { "frame_ms_1_window", "frame_ms_2_windows", "frame_ms_3_windows", "frame_ms_4_windows" };
+      static const char* switch_metric_names[] = { "switches_per_frame_1_window", "switches_per_frame_2_windows", "switches_per_frame_3_windows", "switches_per_frame_4_windows" };
+      int opened[3];
+      int opened_count = 0;
+
+      Window_Set_Bind(set, 0);
+      set->wglSwapIntervalEXT(0);
+      for(int window_count = 1; window_count <= 4; ++window_count) {
+	    if(window_count > 1) {
+		  int index = Window_Set_Open(set, "benchmark window", 320, 240);
+		  if(index < 0) {
+			break;
+		  }
+		  opened[opened_count++] = index;
+	    }
+
+	    LONGLONG start_switches = set->make_current_count;
+	    glFinish();
+	    LARGE_INTEGER start;
+	    LARGE_INTEGER end;
+	    QueryPerformanceCounter(&start);
+	    for(int frame = 0; frame < BENCHMARK_WINDOW_FRAMES; ++frame) {
+		  MSG msg;
+		  while(PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE) != 0) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		  }
+		  for(int w = set->window_count - 1; w >= 0; --w) {
+			if(!set->windows[w].open || Window_Set_Bind(set, w) != 1) {
+			      continue;
+			}
+			glClearColor(0.1f, 0.15f, 0.19f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		  }
+		  Window_Set_Swap(set);
+		  glFinish();
+	    }
+	    QueryPerformanceCounter(&end);
+
+	    Benchmark_Add_Metric(results, "window_count", frame_metric_names[window_count - 1], Benchmark_Elapsed_Seconds(results, start, end) * 1000.0 / (double)BENCHMARK_WINDOW_FRAMES, 0);
+	    Benchmark_Add_Metric(results, "window_count", switch_metric_names[window_count - 1], (double)(set->make_current_count - start_switches) / (double)BENCHMARK_WINDOW_FRAMES, 0);
+      }
+
+      for(int i = 0; i < opened_count; ++i) {
+	    Window_Set_Close(set, opened[i]);
+      }
+      Window_Set_Bind(set, 0);
+      set->wglSwapIntervalEXT(-1);
+}
+
+
+
+static double Benchmark_Process_CPU_Seconds(void)
+{
+      FILETIME creation_time;
+      FILETIME exit_time;
+      FILETIME kernel_time;
+      FILETIME user_time;
+      if(GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time) == 0) {
+	    return 0.0;
+      }
+      ULONGLONG kernel = ((ULONGLONG)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+      ULONGLONG user = ((ULONGLONG)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+      return (double)(kernel + user) * 1e-7; /* 100ns units */
+}
+
+
+
+/* Scenario "idle_window": CPU and GPU use of the window while nothing changes, with the old continuous loop and with the on-demand render scheduler. CPU time is for the whole process (all threads), GPU time is measured with GL_TIME_ELAPSED queries around every rendered frame. Frames are drawn and swapped through the window set like the main loop's. */
+static void Benchmark_Idle_Window(Benchmark_Results* results, Window_Set* set)
+{
+#define BENCHMARK_IDLE_SECONDS 2.0
+      static const char* cpu_metric_names[] = { "continuous_cpu_percent", "on_demand_cpu_percent" };
+      static const char* gpu_metric_names[] = { "continuous_gpu_percent", "on_demand_gpu_percent" };
+      static const char* frame_metric_names[] = { "continuous_frames_per_s", "on_demand_frames_per_s" };
+      Render_Scheduler saved_scheduler = render_scheduler;
+
+      GLuint query;
+      glGenQueries(1, &query);
+      for(int on_demand = 0; on_demand < 2; ++on_demand) {
+	    render_scheduler.on_demand = on_demand;
+	    render_scheduler.animating = 0;
+	    InterlockedExchange(&render_scheduler.invalidation_flags, 0);
+
+	    LONGLONG frame_count = 0;
+	    GLuint64 gpu_nanoseconds = 0;
+	    double cpu_start = Benchmark_Process_CPU_Seconds();
+	    LARGE_INTEGER start;
+	    LARGE_INTEGER now;
+	    QueryPerformanceCounter(&start);
+	    now = start;
+	    while(Benchmark_Elapsed_Seconds(results, start, now) < BENCHMARK_IDLE_SECONDS) {
+		  DWORD remaining_ms = (DWORD)((BENCHMARK_IDLE_SECONDS - Benchmark_Elapsed_Seconds(results, start, now)) * 1000.0) + 1;
+		  Render_Scheduler_Wait(&render_scheduler, remaining_ms);
+
+		  MSG msg;
+		  while(PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE) != 0) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		  }
+
+		  LONG invalidation_flags;
+		  if(Render_Scheduler_Begin_Frame(&render_scheduler, &invalidation_flags) == 1) {
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for(int w = set->window_count - 1; w >= 0; --w) {
+			      if(!set->windows[w].open || Window_Set_Bind(set, w) != 1) {
+				    continue;
+			      }
+			      glClearColor(0.1f, 0.15f, 0.19f, 1.0f);
+			      glClear(GL_COLOR_BUFFER_BIT);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+			Window_Set_Swap(set);
+			glFinish();
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			gpu_nanoseconds += elapsed;
+			frame_count += 1;
+		  }
+		  QueryPerformanceCounter(&now);
+	    }
+	    double seconds = Benchmark_Elapsed_Seconds(results, start, now);
+	    double cpu_seconds = Benchmark_Process_CPU_Seconds() - cpu_start;
+
+	    Benchmark_Add_Metric(results, "idle_window", cpu_metric_names[on_demand], cpu_seconds / seconds * 100.0, 0);
+	    Benchmark_Add_Metric(results, "idle_window", gpu_metric_names[on_demand], (double)gpu_nanoseconds * 1e-9 / seconds * 100.0, 0);
+	    Benchmark_Add_Metric(results, "idle_window", frame_metric_names[on_demand], (double)frame_count / seconds, 0);
+      }
+      glDeleteQueries(1, &query);
+
+      /* keep whatever the messages pumped above invalidated, so the main loop's first frame still renders */
+      LONG invalidation_flags = InterlockedExchange(&render_scheduler.invalidation_flags, 0);
+      render_scheduler = saved_scheduler;
+      Render_Invalidate(&render_scheduler, invalidation_flags | RENDER_INVALIDATE_REQUEST);
+}
+
+
+
+static int Benchmark_Compare_Doubles(const void* a, const void* b)
+{
+      double x = *(const double *)a;
+      double y = *(const double *)b;
+      return (x > y) - (x < y);
+}
+
+
+
+/* Scenario "frame_time": the distribution of the frame times recorded in the main loop. */
+static void Benchmark_Frame_Times(Benchmark_Results* results)
+{
+      int count = results->frame_count;
+      if(count == 0) {
+	    LOG_WARN("no frame times were recorded for the benchmark\n");
+	    return;
+      }
+
+      double sum = 0.0;
+      for(int i = 0; i < count; ++i) {
+	    sum += results->frame_times_ms[i];
+      }
+      qsort(results->frame_times_ms, (size_t)count, sizeof(double), Benchmark_Compare_Doubles);
+
+      double mean = sum / count;
+      Benchmark_Add_Metric(results, "frame_time", "min_ms", results->frame_times_ms[0], 0);
+      Benchmark_Add_Metric(results, "frame_time", "mean_ms", mean, 0);
+      Benchmark_Add_Metric(results, "frame_time", "p50_ms", results->frame_times_ms[(count * 50) / 100], 0);
+      Benchmark_Add_Metric(results, "frame_time", "p90_ms", results->frame_times_ms[(count * 90) / 100], 0);
+      Benchmark_Add_Metric(results, "frame_time", "p99_ms", results->frame_times_ms[(count * 99) / 100], 0);
+      Benchmark_Add_Metric(results, "frame_time", "max_ms", results->frame_times_ms[count - 1], 0);
+      Benchmark_Add_Metric(results, "frame_time", "frames_per_s", 1000.0 / mean, 1);
+}
+
+
+
+/* Writes the results as JSON, one object per scenario holding that scenario's metrics. Returns 1 on success, otherwise 0.
+*/
+static int Benchmark_Write_JSON(Benchmark_Results* results, const char* path)
+{
+      FILE* file = fopen(path, "w");
+      if(file == NULL) {
+	    LOG_ERROR("failed to open the benchmark results file: %s\n", path);
+	    return 0;
+      }
+
+      fprintf(file, "{\n");
+      fprintf(file, "  \"benchmark\": \"win32_window\",\n");
+      fprintf(file, "  \"scenarios\": [");
+      const char* scenario = NULL;
+      for(int i = 0; i < results->metric_count; ++i) {
+	    Benchmark_Metric* metric = &results->metrics[i];
+	    if(scenario == NULL || strcmp(scenario, metric->scenario) != 0) {
+		  /* metrics are added scenario by scenario, so a new scenario name starts a new object */
+		  fprintf(file, "%s\n    { \"name\": \"%s\", \"metrics\": {", (scenario == NULL) ? "" : " } },", metric->scenario);
+		  scenario = metric->scenario;
+	    } else {
+		  fprintf(file, ",");
+	    }
+	    fprintf(file, "\n        \"%s\": %.6g", metric->name, metric->value);
+      }
+      if(scenario != NULL) {
+	    fprintf(file, " } }");
+      }
+      fprintf(file, "\n  ]\n}\n");
+
+      int ok = ferror(file) == 0;
+      fclose(file);
+      if(!ok) {
+	    LOG_ERROR("failed to write the benchmark results file: %s\n", path);
+	    return 0;
+      }
+      LOG_INFO("BENCHMARK: wrote %d metrics to %s\n", results->metric_count, path);
+
+
+      return 1;
+}
+
+
+
+/* Reads a results file written by Benchmark_Write_JSON() and compares every metric in it against the current results. A metric regresses when it is worse than the baseline by more than "tolerance" (as a fraction of the baseline value). Returns the number of regressions, or -1 if the baseline couldn't be read.
+
+This only needs to understand the files we write ourselves, so rather than a general JSON parser it just walks the quoted keys: a "name" key sets the current scenario, and any key followed by a number is a metric of that scenario.
+*/
+static int Benchmark_Compare_Baseline(Benchmark_Results* results, const char* path, double tolerance)
+{
+      FILE* file = fopen(path, "rb");
+      if(file == NULL) {
+	    LOG_ERROR("failed to open the benchmark baseline file: %s\n", path);
+	    return -1;
+      }
+      fseek(file, 0, SEEK_END);
+      long file_size = ftell(file);
+      fseek(file, 0, SEEK_SET);
+      char* text = (char *)malloc((size_t)file_size + 1);
+      if(text == NULL || file_size <= 0 || fread(text, 1, (size_t)file_size, file) != (size_t)file_size) {
+	    LOG_ERROR("failed to read the benchmark baseline file: %s\n", path);
+	    free(text);
+	    fclose(file);
+	    return -1;
+      }
+      text[file_size] = '\0';
+      fclose(file);
+
+      int regression_count = 0;
+      int compared_count = 0;
+      char scenario[64] = "";
+      char key[64];
+      const char* p = text;
+      while((p = strchr(p, '"')) != NULL) {
+	    /* read the quoted key */
+	    p += 1;
+	    int key_length = 0;
+	    while(*p != '"' && *p != '\0') {
+		  if(key_length < (int)sizeof(key) - 1) {
+			key[key_length++] = *p;
+		  }
+		  p += 1;
+	    }
+	    key[key_length] = '\0';
+	    if(*p == '\0') {
+		  break;
+	    }
+	    p += 1;
+
+	    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+		  p += 1;
+	    }
+	    if(*p != ':') {
+		  continue;
+	    }
+	    p += 1;
+	    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+		  p += 1;
+	    }
+
+	    if(strcmp(key, "name") == 0 && *p == '"') {
+		  p += 1;
+		  int scenario_length = 0;
+		  while(*p != '"' && *p != '\0') {
+			if(scenario_length < (int)sizeof(scenario) - 1) {
+			      scenario[scenario_length++] = *p;
+			}
+			p += 1;
+		  }
+		  scenario[scenario_length] = '\0';
+		  if(*p == '"') {
+			p += 1;
+		  }
+		  continue;
+	    }
+	    if(scenario[0] == '\0' || !((*p >= '0' && *p <= '9') || *p == '-' || *p == '.')) {
+		  continue;
+	    }
+
+	    char* number_end;
+	    double baseline_value = strtod(p, &number_end);
+	    p = number_end;
+
+	    Benchmark_Metric* metric = NULL;
+	    for(int i = 0; i < results->metric_count; ++i) {
+		  if(strcmp(results->metrics[i].scenario, scenario) == 0 && strcmp(results->metrics[i].name, key) == 0) {
+			metric = &results->metrics[i];
+			break;
+		  }
+	    }
+	    if(metric == NULL) {
+		  LOG_WARN("benchmark baseline has %s.%s but the current run doesn't\n", scenario, key);
+		  continue;
+	    }
+
+	    compared_count += 1;
+	    double change = (baseline_value != 0.0) ? (metric->value - baseline_value) / baseline_value : 0.0;
+	    int regressed = metric->higher_is_better ? (change < -tolerance) : (change > tolerance);
+	    if(regressed) {
+		  regression_count += 1;
+		  LOG_ERROR("BENCHMARK REGRESSION: %s.%s baseline %.6g current %.6g (%+.1f%%, tolerance %.1f%%)\n", scenario, key, baseline_value, metric->value, change * 100.0, tolerance * 100.0);
+	    } else {
+		  LOG_INFO("BENCHMARK: %s.%s baseline %.6g current %.6g (%+.1f%%)\n", scenario, key, baseline_value, metric->value, change * 100.0);
+	    }
+      }
+      free(text);
+
+      LOG_INFO("BENCHMARK: compared %d metrics against %s, %d regressions\n", compared_count, path, regression_count);
+
+
+      return regression_count;
+}
+
+
+
+
+static unsigned int Simulation_Checksum(const Simulation_Snapshot* snapshot)
+{
+      /* FNV-1a over everything in the snapshot before the checksum itself */
+      const unsigned char* bytes = (const unsigned char *)snapshot;
+      size_t size = offsetof(Simulation_Snapshot, checksum);
+      unsigned int hash = 2166136261u;
+      for(size_t i = 0; i < size; ++i) {
+	    hash ^= bytes[i];
+	    hash *= 16777619u;
+      }
+      return hash;
+}
+
+
+
+static void Simulation_Initial_State(Simulation_State* state)
+{
+      memset(state, 0, sizeof(Simulation_State));
+      state->triangle_angle = 0.0f;
+      state->triangle_angular_velocity = 0.5f; /* radians per second */
+}
+
+
+
+/* Puts the initial state at tick 0, due at "start_counter", into every snapshot slot, and hands out the slots. */
+static void Simulation_Init_Snapshots(Simulation* simulation, LONGLONG start_counter)
+{
+      Simulation_State initial_state;
+      Simulation_Initial_State(&initial_state);
+      for(int i = 0; i < 3; ++i) {
+	    Simulation_Snapshot* snapshot = &simulation->snapshots[i];
+	    snapshot->tick = 0;
+	    snapshot->tick_counter = start_counter;
+	    snapshot->previous = initial_state;
+	    snapshot->current = initial_state;
+	    snapshot->checksum = Simulation_Checksum(snapshot);
+      }
+      simulation->back_index = 0;
+      simulation->exchange = 1;
+      simulation->front_index = 2;
+}
+
+
+
+/* Sets up the snapshots with the initial state at tick 0 and starts the simulation thread. Returns 1 on success, otherwise 0.
+*/
+static int Simulation_Init(Simulation* simulation)
+{
+      memset(simulation, 0, sizeof(Simulation));
+
+      LARGE_INTEGER performance_value;
+      QueryPerformanceFrequency(&performance_value);
+      simulation->counter_frequency = performance_value.QuadPart;
+      simulation->tick_counts = performance_value.QuadPart / SIMULATION_TICKS_PER_SECOND;
+      QueryPerformanceCounter(&performance_value);
+      Simulation_Init_Snapshots(simulation, performance_value.QuadPart);
+
+      /* a high resolution waitable timer lets the thread sleep until the next tick with sub-millisecond precision, instead of Sleep()'s scheduler tick granularity. It needs Windows 10 1803 or later, so we fall back to a regular one. */
+      simulation->timer = CreateWaitableTimerExA(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+      if(simulation->timer == NULL) {
+	    simulation->timer = CreateWaitableTimerA(NULL, FALSE, NULL);
+      }
+      if(simulation->timer == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("CreateWaitableTimerA() failed to create the simulation timer - win32 error code: %ld\n", win32_error_val);
+	    return 0;
+      }
+      simulation->wake_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+      if(simulation->wake_event == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("CreateEventA() failed to create the simulation wake event - win32 error code: %ld\n", win32_error_val);
+	    CloseHandle(simulation->timer);
+	    return 0;
+      }
+
+      simulation->running = 1;
+      simulation->thread = CreateThread(NULL, 0, Simulation_Thread, simulation, 0, NULL);
+      if(simulation->thread == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("CreateThread() failed to create the simulation thread - win32 error code: %ld\n", win32_error_val);
+	    CloseHandle(simulation->timer);
+	    CloseHandle(simulation->wake_event);
+	    return 0;
+      }
+
+
+      return 1;
+}
+
+
+
+static void Simulation_Shutdown(Simulation* simulation)
+{
+      InterlockedExchange(&simulation->running, 0);
+      SetEvent(simulation->wake_event);
+      WaitForSingleObject(simulation->thread, INFINITE);
+      CloseHandle(simulation->thread);
+      CloseHandle(simulation->timer);
+      CloseHandle(simulation->wake_event);
+
+      if(simulation->skipped_tick_count > 0) {
+	    LOG_WARN("the simulation fell behind and skipped %lld ticks\n", (long long)simulation->skipped_tick_count);
+      }
+}
+
+
+
+/* Advances the simulation by one fixed tick of "dt" seconds. */
+static void Simulation_Step(Simulation_State* state, float dt)
+{
+      state->triangle_angle += state->triangle_angular_velocity * dt;
+      if(state->triangle_angle > 6.28318530718f) {
+	    state->triangle_angle -= 6.28318530718f;
+      }
+}
+
+
+
+/* Fills in the back slot with the ticks "previous" and "current", and swaps it with the middle. Only called from the thread that owns the back slot. */
+static void Simulation_Publish(Simulation* simulation, LONGLONG tick, LONGLONG tick_counter, const Simulation_State* previous, const Simulation_State* current)
+{
+      Simulation_Snapshot* snapshot = &simulation->snapshots[simulation->back_index];
+      snapshot->tick = tick;
+      snapshot->tick_counter = tick_counter;
+      snapshot->previous = *previous;
+      snapshot->current = *current;
+      snapshot->checksum = Simulation_Checksum(snapshot);
+      LONG old_exchange = InterlockedExchange(&simulation->exchange, simulation->back_index | SIMULATION_SNAPSHOT_NEW); /* full barrier, the snapshot is written before it is published */
+      simulation->back_index = old_exchange & SIMULATION_SNAPSHOT_INDEX_MASK;
+}
+
+
+
+/* Starts "clock" from the snapshot in the back slot, with the first tick due one tick after it. */
+static void Simulation_Clock_Init(Simulation* simulation, Simulation_Clock* clock)
+{
+      const Simulation_Snapshot* snapshot = &simulation->snapshots[simulation->back_index];
+      clock->state = snapshot->current;
+      clock->previous_state = snapshot->current;
+      clock->tick = snapshot->tick;
+      clock->next_tick_counter = snapshot->tick_counter + simulation->tick_counts;
+}
+
+
+
+/* Runs every tick that is due at "now_counter", and publishes a snapshot of the last two if there were any. Returns the number of ticks run. Only called from the thread that owns the back slot.
+*/
+static int Simulation_Run_Due_Ticks(Simulation* simulation, Simulation_Clock* clock, LONGLONG now_counter)
+{
+      const float dt = 1.0f / (float)SIMULATION_TICKS_PER_SECOND;
+
+      int tick_count = 0;
+      while(now_counter >= clock->next_tick_counter && tick_count < SIMULATION_MAX_CATCHUP_TICKS) {
+	    clock->previous_state = clock->state;
+	    clock->tick += 1;
+	    Simulation_Step(&clock->state, dt);
+	    clock->next_tick_counter += simulation->tick_counts;
+	    tick_count += 1;
+      }
+      if(now_counter >= clock->next_tick_counter) {
+	    /* we're too far behind, so we drop the missed time rather than spiralling. This only shifts the simulation against the wall clock, every tick is still simulated with the same dt. */
+	    LONGLONG skipped_ticks = (now_counter - clock->next_tick_counter) / simulation->tick_counts + 1;
+	    InterlockedExchangeAdd64(&simulation->skipped_tick_count, skipped_ticks);
+	    clock->next_tick_counter += skipped_ticks * simulation->tick_counts;
+      }
+
+      if(tick_count > 0) {
+	    /* the last tick was due one tick before the next one, with every pause and skip already applied */
+	    Simulation_Publish(simulation, clock->tick, clock->next_tick_counter - simulation->tick_counts, &clock->previous_state, &clock->state);
+      }
+
+
+      return tick_count;
+}
+
+
+
+/* Simulation thread procedure. Runs every tick that is due, publishes a snapshot of the last two ticks, and then sleeps until the next tick is due.
+*/
+static DWORD WINAPI Simulation_Thread(LPVOID param)
+{
+      Simulation* simulation = (Simulation *)param;
+
+      Simulation_Clock clock;
+      Simulation_Clock_Init(simulation, &clock);
+
+      while(simulation->running) {
+	    LARGE_INTEGER now;
+	    QueryPerformanceCounter(&now);
+
+	    if(simulation->paused) {
+		  /* no ticks pass while paused, so when we resume the clock is moved forward by however long we were paused */
+		  WaitForSingleObject(simulation->wake_event, INFINITE);
+		  LARGE_INTEGER resume;
+		  QueryPerformanceCounter(&resume);
+		  clock.next_tick_counter += resume.QuadPart - now.QuadPart;
+		  continue;
+	    }
+
+	    if(now.QuadPart < clock.next_tick_counter) {
+		  /* relative due time in 100ns units (negative means relative) */
+		  LARGE_INTEGER due_time;
+		  due_time.QuadPart = -(LONGLONG)((double)(clock.next_tick_counter - now.QuadPart) * 1e7 / (double)simulation->counter_frequency);
+		  if(due_time.QuadPart < 0 && SetWaitableTimer(simulation->timer, &due_time, 0, NULL, NULL, FALSE)) {
+			WaitForSingleObject(simulation->timer, INFINITE);
+		  } else {
+			YieldProcessor();
+		  }
+		  continue;
+	    }
+
+	    Simulation_Run_Due_Ticks(simulation, &clock, now.QuadPart);
+      }
+
+
+      return 0;
+}
+
+
+
+/* Pausing blocks the simulation thread, so a paused simulation costs nothing. It can be called from any thread. */
+static void Simulation_Set_Paused(Simulation* simulation, int paused)
+{
+      InterlockedExchange(&simulation->paused, paused);
+      SetEvent(simulation->wake_event);
+}
+
+
+
+/* Returns the newest snapshot the simulation has published. It stays valid (and unchanged) until the next call. Only one thread may acquire snapshots at a time.
+*/
+static const Simulation_Snapshot* Simulation_Acquire_Snapshot(Simulation* simulation)
+{
+      if(simulation->exchange & SIMULATION_SNAPSHOT_NEW) {
+	    LONG old_exchange = InterlockedExchange(&simulation->exchange, simulation->front_index);
+	    simulation->front_index = old_exchange & SIMULATION_SNAPSHOT_INDEX_MASK;
+      }
+
+      const Simulation_Snapshot* snapshot = &simulation->snapshots[simulation->front_index];
+#if SIMULATION_VALIDATE_SNAPSHOTS
+      if(Simulation_Checksum(snapshot) != snapshot->checksum) {
+	    LOG_ERROR("torn simulation snapshot at tick %lld, the snapshot exchange is broken\n", (long long)snapshot->tick);
+      }
+#endif
+
+
+      return snapshot;
+}
+
+
+
+/* Interpolates between the two ticks in "snapshot" for the wall clock time "now_counter". The render side runs one tick behind the simulation, so that the newest snapshot normally brackets the time being rendered. If the simulation is late, the newest tick is used as it is.
+*/
+static void Simulation_Interpolate(Simulation* simulation, const Simulation_Snapshot* snapshot, LONGLONG now_counter, Simulation_State* state)
+{
+      /* one tick behind "current" is "previous", so the time since "current" was due is how far we are from "previous" to "current" */
+      double alpha = (double)(now_counter - snapshot->tick_counter) / (double)simulation->tick_counts;
+      if(alpha < 0.0) {
+	    alpha = 0.0;
+      }
+      if(alpha > 1.0) {
+	    alpha = 1.0;
+      }
+
+      float a = (float)alpha;
+      *state = snapshot->current;
+
+      /* angles wrap, so interpolate along the shortest way round */
+      float angle_delta = snapshot->current.triangle_angle - snapshot->previous.triangle_angle;
+      if(angle_delta > 3.14159265359f) {
+	    angle_delta -= 6.28318530718f;
+      } else if(angle_delta < -3.14159265359f) {
+	    angle_delta += 6.28318530718f;
+      }
+      state->triangle_angle = snapshot->previous.triangle_angle + angle_delta * a;
+      state->triangle_angular_velocity = snapshot->previous.triangle_angular_velocity + (snapshot->current.triangle_angular_velocity - snapshot->previous.triangle_angular_velocity) * a;
+}
+
+
+
+
+#define SIMULATION_TEST_TICKS (60 * 60 * 10) /* ten minutes of simulated time per cadence */
+#define SIMULATION_TEST_PUBLISHES 2000000
+#define SIMULATION_TEST_TICK_COUNTS 1000 /* the made up clock's counts per tick */
+
+typedef struct Simulation_Test_Cadence {
+      Simulation* simulation;
+      const Simulation_State* reference; /* the straight line run, indexed by tick */
+      unsigned int max_delta_counts; /* the clock moves on by up to this much between two publishes */
+      unsigned int random_state;
+      LONGLONG error_count;
+      volatile LONG done;
+} Simulation_Test_Cadence;
+
+/* Simulation thread stand-in for Simulation_Test_Determinism(). Drives Simulation_Run_Due_Ticks(), the tick loop of the real thread, with a made up clock that moves on by a random amount each time, so some calls run no ticks, some a few, and some more than SIMULATION_MAX_CATCHUP_TICKS and skip. */
+static DWORD WINAPI Simulation_Test_Cadence_Thread(LPVOID param)
+{
+      Simulation_Test_Cadence* cadence = (Simulation_Test_Cadence *)param;
+      Simulation* simulation = cadence->simulation;
+
+      Simulation_Clock clock;
+      Simulation_Clock_Init(simulation, &clock);
+      LONGLONG now_counter = 0;
+      while(clock.tick < SIMULATION_TEST_TICKS) {
+	    cadence->random_state = cadence->random_state * 1664525u + 1013904223u;
+	    now_counter += (cadence->random_state >> 8) % (cadence->max_delta_counts + 1);
+	    Simulation_Run_Due_Ticks(simulation, &clock, now_counter);
+	    if(memcmp(&clock.state, &cadence->reference[clock.tick], sizeof(Simulation_State)) != 0) {
+		  cadence->error_count += 1;
+	    }
+      }
+      InterlockedExchange(&cadence->done, 1);
+
+
+      return 0;
+}
+
+
+
+/* Self test: the simulation must reach the same state at every tick however the ticks are spread over wall clock time. A straight line run of Simulation_Step() is the reference. Then for several publish cadences, a thread runs the real tick loop (Simulation_Run_Due_Ticks()) against a made up clock with random steps, while this thread acquires snapshots at its own random render cadence. Both sides check every state they see against the reference at the same tick, bit for bit. Returns 1 if it passed.
+*/
+static int Simulation_Test_Determinism(void)
+{
+      static const unsigned int max_delta_counts[] = {
+	    SIMULATION_TEST_TICK_COUNTS / 4, /* several publish attempts per tick, most of which run nothing */
+	    SIMULATION_TEST_TICK_COUNTS * 3, /* a few ticks per publish */
+	    SIMULATION_TEST_TICK_COUNTS * (SIMULATION_MAX_CATCHUP_TICKS * 4) /* far behind, with catch-up limits and skips */
+      };
+      static const int max_render_spins[] = { 0, 64, 4096 };
+      const float dt = 1.0f / (float)SIMULATION_TICKS_PER_SECOND;
+      int reference_count = SIMULATION_TEST_TICKS + SIMULATION_MAX_CATCHUP_TICKS + 1; /* the last call can run past SIMULATION_TEST_TICKS */
+      Simulation_State* reference = (Simulation_State *)malloc(sizeof(Simulation_State) * reference_count);
+      if(reference == NULL) {
+	    LOG_ERROR("SELF TEST: simulation_determinism failed to allocate the reference states\n");
+	    return 0;
+      }
+      Simulation_Initial_State(&reference[0]);
+      for(int tick = 1; tick < reference_count; ++tick) {
+	    reference[tick] = reference[tick - 1];
+	    Simulation_Step(&reference[tick], dt);
+      }
+
+      LONGLONG error_count = 0;
+      int cadence_count = (int)(sizeof(max_delta_counts) / sizeof(max_delta_counts[0]));
+      for(int c = 0; c < cadence_count && error_count == 0; ++c) {
+	    Simulation simulation;
+	    memset(&simulation, 0, sizeof(Simulation));
+	    simulation.tick_counts = SIMULATION_TEST_TICK_COUNTS;
+	    simulation.counter_frequency = SIMULATION_TEST_TICK_COUNTS * SIMULATION_TICKS_PER_SECOND;
+	    Simulation_Init_Snapshots(&simulation, 0);
+
+	    Simulation_Test_Cadence cadence;
+	    cadence.simulation = &simulation;
+	    cadence.reference = reference;
+	    cadence.max_delta_counts = max_delta_counts[c];
+	    cadence.random_state = 0x2545F491u + (unsigned int)c;
+	    cadence.error_count = 0;
+	    cadence.done = 0;
+	    HANDLE thread = CreateThread(NULL, 0, Simulation_Test_Cadence_Thread, &cadence, 0, NULL);
+	    if(thread == NULL) {
+		  DWORD win32_error_val = GetLastError();
+		  LOG_ERROR("SELF TEST: simulation_determinism failed to create the simulation thread - win32 error code: %ld\n", win32_error_val);
+		  free(reference);
+		  return 0;
+	    }
+
+	    unsigned int random_state = 0x9E3779B9u + (unsigned int)c;
+	    LONGLONG last_tick = 0;
+	    int last_pass = 0;
+	    for(;;) {
+		  int done = cadence.done; /* read before acquiring, so the acquire after this is guaranteed to see the last tick */
+		  const Simulation_Snapshot* snapshot = Simulation_Acquire_Snapshot(&simulation);
+		  if(snapshot->tick < last_tick ||
+		     memcmp(&snapshot->current, &reference[snapshot->tick], sizeof(Simulation_State)) != 0 ||
+		     (snapshot->tick > 0 && memcmp(&snapshot->previous, &reference[snapshot->tick - 1], sizeof(Simulation_State)) != 0)) {
+			if(error_count == 0) {
+			      LOG_ERROR("SELF TEST: simulation_determinism got a snapshot that differs from the straight line run at tick %lld (cadence %d)\n", (long long)snapshot->tick, c);
+			}
+			error_count += 1;
+		  }
+		  last_tick = snapshot->tick;
+
+		  if(last_pass) {
+			break;
+		  }
+		  last_pass = done;
+
+		  random_state = random_state * 1664525u + 1013904223u;
+		  for(int spin = (int)((random_state >> 8) % (unsigned int)(max_render_spins[c] + 1)); spin > 0; --spin) {
+			YieldProcessor();
+		  }
+	    }
+	    WaitForSingleObject(thread, INFINITE);
+	    CloseHandle(thread);
+
+	    if(cadence.error_count > 0) {
+		  LOG_ERROR("SELF TEST: simulation_determinism, the tick loop diverged from the straight line run %lld times (cadence %d)\n", (long long)cadence.error_count, c);
+		  error_count += cadence.error_count;
+	    }
+	    if(last_tick < SIMULATION_TEST_TICKS) {
+		  LOG_ERROR("SELF TEST: simulation_determinism ended on tick %lld instead of at least %d (cadence %d)\n", (long long)last_tick, SIMULATION_TEST_TICKS, c);
+		  error_count += 1;
+	    }
+      }
+      free(reference);
+
+      if(error_count > 0) {
+	    LOG_ERROR("SELF TEST: simulation_determinism failed\n");
+	    return 0;
+      }
+      LOG_INFO("SELF TEST: simulation_determinism passed, %d ticks at %d cadences\n", SIMULATION_TEST_TICKS, cadence_count);
+
+
+      return 1;
+}
+
+
+
+typedef struct Simulation_Test_Writer {
+      Simulation* simulation;
+      volatile LONG done;
+} Simulation_Test_Writer;
+
+/* Writer thread of Simulation_Test_Exchange(), publishes SIMULATION_TEST_PUBLISHES ticks back to back with the tick number as the tick's wall clock time. */
+static DWORD WINAPI Simulation_Test_Writer_Thread(LPVOID param)
+{
+      Simulation_Test_Writer* writer = (Simulation_Test_Writer *)param;
+      const float dt = 1.0f / (float)SIMULATION_TICKS_PER_SECOND;
+
+      Simulation_State state;
+      Simulation_Initial_State(&state);
+      for(LONGLONG tick = 1; tick <= SIMULATION_TEST_PUBLISHES; ++tick) {
+	    Simulation_State previous_state = state;
+	    Simulation_Step(&state, dt);
+	    Simulation_Publish(writer->simulation, tick, tick, &previous_state, &state);
+      }
+      InterlockedExchange(&writer->done, 1);
+
+
+      return 0;
+}
+
+
+
+/* Self test: a writer thread publishes snapshots through the triple buffer as fast as it can, while this thread acquires them as fast as it can. Every snapshot we get must be internally consistent: its checksum matches, "current" is exactly one step on from "previous", its wall clock time belongs to its tick, and ticks never go backwards. Once the writer is done, the next acquire must see its last tick. Returns 1 if it passed.
+*/
+static int Simulation_Test_Exchange(void)
+{
+      const float dt = 1.0f / (float)SIMULATION_TICKS_PER_SECOND;
+      Simulation simulation;
+      memset(&simulation, 0, sizeof(Simulation));
+      Simulation_Init_Snapshots(&simulation, 0);
+
+      Simulation_Test_Writer writer;
+      writer.simulation = &simulation;
+      writer.done = 0;
+      HANDLE thread = CreateThread(NULL, 0, Simulation_Test_Writer_Thread, &writer, 0, NULL);
+      if(thread == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("SELF TEST: simulation_exchange failed to create the writer thread - win32 error code: %ld\n", win32_error_val);
+	    return 0;
+      }
+
+      LONGLONG acquire_count = 0;
+      LONGLONG new_count = 0;
+      LONGLONG error_count = 0;
+      LONGLONG last_tick = 0;
+      int last_pass = 0;
+      for(;;) {
+	    int done = writer.done; /* read before acquiring, so the acquire after this is guaranteed to see the last tick */
+	    const Simulation_Snapshot* snapshot = Simulation_Acquire_Snapshot(&simulation);
+	    acquire_count += 1;
+
+	    Simulation_State stepped = snapshot->previous;
+	    Simulation_Step(&stepped, dt);
+	    int consistent = Simulation_Checksum(snapshot) == snapshot->checksum && snapshot->tick_counter == snapshot->tick && snapshot->tick >= last_tick &&
+			     (snapshot->tick == 0 || memcmp(&stepped, &snapshot->current, sizeof(Simulation_State)) == 0);
+	    if(!consistent) {
+		  if(error_count == 0) {
+			LOG_ERROR("SELF TEST: simulation_exchange got an inconsistent snapshot at tick %lld (the last one was %lld)\n", (long long)snapshot->tick, (long long)last_tick);
+		  }
+		  error_count += 1;
+	    }
+	    if(snapshot->tick != last_tick) {
+		  new_count += 1;
+		  last_tick = snapshot->tick;
+	    }
+
+	    if(last_pass) {
+		  break;
+	    }
+	    last_pass = done;
+      }
+      WaitForSingleObject(thread, INFINITE);
+      CloseHandle(thread);
+
+      if(last_tick != SIMULATION_TEST_PUBLISHES) {
+	    LOG_ERROR("SELF TEST: simulation_exchange ended on tick %lld instead of the last published tick %d\n", (long long)last_tick, SIMULATION_TEST_PUBLISHES);
+	    error_count += 1;
+      }
+      if(error_count > 0) {
+	    LOG_ERROR("SELF TEST: simulation_exchange failed, %lld of %lld snapshots were wrong\n", (long long)error_count, (long long)acquire_count);
+	    return 0;
+      }
+      LOG_INFO("SELF TEST: simulation_exchange passed, %lld snapshots acquired, %lld of them new\n", (long long)acquire_count, (long long)new_count);
+
+
+      return 1;
+}
+
+
+
+
+/* Returns 1 on success, otherwise 0 if the resource table couldn't be allocated.
+*/
+static int Gpu_Pool_Init(Gpu_Pool* pool, GLsizeiptr budget_bytes)
+{
+      memset(pool, 0, sizeof(Gpu_Pool));
+      pool->resources = (Gpu_Resource *)malloc(sizeof(Gpu_Resource) * GPU_POOL_MAX_RESOURCES);
+      if(pool->resources == NULL) {
+	    return 0;
+      }
+      pool->unused_head = -1;
+      pool->lru_head = -1;
+      pool->lru_tail = -1;
+      pool->budget_bytes = budget_bytes;
+      pool->retired_frame = -1;
+
+
+      return 1;
+}
+
+
+
+static void Gpu_Pool_Destroy_Resource(Gpu_Pool* pool, int index)
+{
+      Gpu_Resource* resource = &pool->resources[index];
+      switch(resource->kind) {
+      case GPU_RESOURCE_BUFFER:
+	    glDeleteBuffers(1, &resource->name);
+	    break;
+      case GPU_RESOURCE_TEXTURE:
+	    glDeleteTextures(1, &resource->name);
+	    break;
+      case GPU_RESOURCE_FRAMEBUFFER:
+	    glDeleteFramebuffers(1, &resource->name);
+	    glDeleteTextures(1, &resource->texture);
+	    break;
+      }
+      pool->allocated_bytes -= resource->bytes;
+
+      resource->name = 0;
+      resource->lru_next = pool->unused_head;
+      pool->unused_head = index;
+}
+
+
+
+/* Deletes every resource, including ones that were never released. The context must still be current. */
+static void Gpu_Pool_Shutdown(Gpu_Pool* pool)
+{
+      int leaked_count = 0;
+      for(int i = 0; i < pool->resource_count; ++i) {
+	    if(pool->resources[i].name == 0) {
+		  continue;
+	    }
+	    if(pool->resources[i].in_use) {
+		  leaked_count += 1;
+	    }
+	    Gpu_Pool_Destroy_Resource(pool, i);
+      }
+      for(int i = 0; i < pool->fence_count; ++i) {
+	    glDeleteSync(pool->fences[(pool->fence_first + i) % GPU_POOL_FRAMES_IN_FLIGHT]);
+      }
+      free(pool->resources);
+      pool->resources = NULL;
+
+      if(leaked_count > 0) {
+	    LOG_WARN("%d GPU pool resources were never released\n", leaked_count);
+      }
+}
+
+
+
+static void Gpu_Pool_LRU_Remove(Gpu_Pool* pool, int index)
+{
+      Gpu_Resource* resource = &pool->resources[index];
+      if(resource->lru_prev >= 0) {
+	    pool->resources[resource->lru_prev].lru_next = resource->lru_next;
+      } else {
+	    pool->lru_head = resource->lru_next;
+      }
+      if(resource->lru_next >= 0) {
+	    pool->resources[resource->lru_next].lru_prev = resource->lru_prev;
+      } else {
+	    pool->lru_tail = resource->lru_prev;
+      }
+}
+
+
+
+/* Deletes released resources that have retired, least recently used first, until the pool is within "budget_bytes" or "max_count" resources have been deleted. */
+static void Gpu_Pool_Evict(Gpu_Pool* pool, GLsizeiptr budget_bytes, int max_count)
+{
+      int index = pool->lru_tail;
+      int evicted_count = 0;
+      while(pool->allocated_bytes > budget_bytes && evicted_count < max_count && index >= 0) {
+	    int previous = pool->resources[index].lru_prev;
+	    if(pool->resources[index].release_frame <= pool->retired_frame) {
+		  evicted_count += 1;
+		  pool->stats.eviction_count += 1;
+		  pool->stats.evicted_bytes += pool->resources[index].bytes;
+		  Gpu_Pool_LRU_Remove(pool, index);
+		  Gpu_Pool_Destroy_Resource(pool, index);
+	    }
+	    index = previous;
+      }
+}
+
+
+
+static GLsizeiptr Gpu_Format_Bytes_Per_Pixel(GLenum format)
+{
+      switch(format) {
+      case GL_R8: return 1;
+      case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+      case GL_RGBA16F: case GL_RG32F: return 8;
+      case GL_RGBA32F: return 16;
+      }
+      return 4; /* GL_RGBA8, GL_SRGB8_ALPHA8, GL_R32F, GL_RG16F, GL_DEPTH24_STENCIL8, GL_DEPTH_COMPONENT32F... */
+}
+
+
+
+static Gpu_Resource* Gpu_Pool_Acquire(Gpu_Pool* pool, int kind, GLenum format, GLsizeiptr size, GLsizei width, GLsizei height)
+{
+      pool->stats.acquire_count += 1;
+
+      /* most recently released first, since those are the likeliest to still be resident */
+      for(int index = pool->lru_head; index >= 0; index = pool->resources[index].lru_next) {
+	    Gpu_Resource* resource = &pool->resources[index];
+	    if(resource->kind == kind && resource->format == format && resource->size == size &&
+	       resource->width == width && resource->height == height && resource->release_frame <= pool->retired_frame) {
+		  Gpu_Pool_LRU_Remove(pool, index);
+		  resource->in_use = 1;
+		  pool->stats.hit_count += 1;
+		  return resource;
+	    }
+      }
+
+      int index;
+      if(pool->unused_head >= 0) {
+	    index = pool->unused_head;
+	    pool->unused_head = pool->resources[index].lru_next;
+      } else if(pool->resource_count < GPU_POOL_MAX_RESOURCES) {
+	    index = pool->resource_count++;
+      } else {
+	    Gpu_Pool_Evict(pool, 0, 1); /* out of slots, so free the least recently used resource that has retired */
+	    if(pool->unused_head < 0) {
+		  LOG_ERROR("GPU resource pool is full, %d resources in use\n", GPU_POOL_MAX_RESOURCES);
+		  return NULL;
+	    }
+	    index = pool->unused_head;
+	    pool->unused_head = pool->resources[index].lru_next;
+      }
+
+      Gpu_Resource* resource = &pool->resources[index];
+      memset(resource, 0, sizeof(Gpu_Resource));
+      resource->kind = kind;
+      resource->format = format;
+      resource->size = size;
+      resource->width = width;
+      resource->height = height;
+      resource->in_use = 1;
+      resource->lru_prev = -1;
+      resource->lru_next = -1;
+
+      /* immutable storage, nothing can reallocate a pooled resource behind our back */
+      switch(kind) {
+      case GPU_RESOURCE_BUFFER:
+	    glCreateBuffers(1, &resource->name);
+	    glNamedBufferStorage(resource->name, size, NULL, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT);
+	    resource->bytes = size;
+	    break;
+      case GPU_RESOURCE_TEXTURE:
+	    glCreateTextures(GL_TEXTURE_2D, 1, &resource->name);
+	    glTextureStorage2D(resource->name, 1, format, width, height);
+	    resource->bytes = (GLsizeiptr)width * height * Gpu_Format_Bytes_Per_Pixel(format);
+	    break;
+      case GPU_RESOURCE_FRAMEBUFFER: {
+	    GLenum attachment = GL_COLOR_ATTACHMENT0;
+	    if(format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8) {
+		  attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+	    } else if(format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F) {
+		  attachment = GL_DEPTH_ATTACHMENT;
+	    }
+	    glCreateTextures(GL_TEXTURE_2D, 1, &resource->texture);
+	    glTextureStorage2D(resource->texture, 1, format, width, height);
+	    glCreateFramebuffers(1, &resource->name);
+	    glNamedFramebufferTexture(resource->name, attachment, resource->texture, 0);
+	    resource->bytes = (GLsizeiptr)width * height * Gpu_Format_Bytes_Per_Pixel(format);
+	    break;
+      }
+      }
+
+      pool->allocated_bytes += resource->bytes;
+      if(pool->allocated_bytes > pool->stats.peak_bytes) {
+	    pool->stats.peak_bytes = pool->allocated_bytes;
+      }
+      Gpu_Pool_Evict(pool, pool->budget_bytes, GPU_POOL_MAX_RESOURCES);
+
+
+      return resource;
+}
+
+
+
+/* Returns a buffer of at least "size" bytes with immutable GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT storage, or NULL if the pool is full. The size is rounded up to a power of two size class.
+*/
+static Gpu_Resource* Gpu_Pool_Acquire_Buffer(Gpu_Pool* pool, GLsizeiptr size)
+{
+      GLsizeiptr size_class = GPU_POOL_MIN_BUFFER_SIZE;
+      while(size_class < size) {
+	    size_class *= 2;
+      }
+      return Gpu_Pool_Acquire(pool, GPU_RESOURCE_BUFFER, 0, size_class, 0, 0);
+}
+
+
+
+/* Returns a single mip level GL_TEXTURE_2D of the internal format that is at least "width" by "height", or NULL if the pool is full. Each dimension is rounded up to a power of two size class, the resource's "width" and "height" are the texture's real size.
+*/
+static Gpu_Resource* Gpu_Pool_Acquire_Texture(Gpu_Pool* pool, GLenum format, GLsizei width, GLsizei height)
+{
+      GLsizei width_class = GPU_POOL_MIN_TEXTURE_SIZE;
+      while(width_class < width) {
+	    width_class *= 2;
+      }
+      GLsizei height_class = GPU_POOL_MIN_TEXTURE_SIZE;
+      while(height_class < height) {
+	    height_class *= 2;
+      }
+      return Gpu_Pool_Acquire(pool, GPU_RESOURCE_TEXTURE, format, 0, width_class, height_class);
+}
+
+
+
+/* Returns a framebuffer with one texture of the exact size and internal format attached ("texture" in the resource), or NULL if the pool is full. Depth formats are attached as the depth (stencil) attachment, everything else as color attachment 0.
+*/
+static Gpu_Resource* Gpu_Pool_Acquire_Framebuffer(Gpu_Pool* pool, GLenum format, GLsizei width, GLsizei height)
+{
+      return Gpu_Pool_Acquire(pool, GPU_RESOURCE_FRAMEBUFFER, format, 0, width, height);
+}
+
+
+
+/* Gives a resource back to the pool. GL commands that use it may still be queued, it won't be handed out again until the current frame has retired. Releasing NULL or a resource that was already released does nothing. */
+static void Gpu_Pool_Release(Gpu_Pool* pool, Gpu_Resource* resource)
+{
+      if(resource == NULL) {
+	    return;
+      }
+      assert(resource >= pool->resources && resource < pool->resources + pool->resource_count); /* from another pool */
+      if(!resource->in_use) {
+	    return; /* linking it in twice would make a cycle in the LRU list */
+      }
+      int index = (int)(resource - pool->resources);
+      resource->in_use = 0;
+      resource->release_frame = pool->frame_index;
+      resource->lru_prev = -1;
+      resource->lru_next = pool->lru_head;
+      if(pool->lru_head >= 0) {
+	    pool->resources[pool->lru_head].lru_prev = index;
+      } else {
+	    pool->lru_tail = index;
+      }
+      pool->lru_head = index;
+}
+
+
+
+/* Call once per frame after the frame's GL commands have been submitted. Fences the frame, retires every earlier frame whose fence has signaled (without waiting, unless more than GPU_POOL_FRAMES_IN_FLIGHT frames are queued), and evicts down to the budget.
+*/
+static void Gpu_Pool_End_Frame(Gpu_Pool* pool)
+{
+      for(;;) {
+	    while(pool->fence_count > 0) {
+		  GLsync fence = pool->fences[pool->fence_first];
+		  GLenum status = glClientWaitSync(fence, 0, 0);
+		  if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			break;
+		  }
+		  pool->retired_frame = pool->fence_frames[pool->fence_first];
+		  glDeleteSync(fence);
+		  pool->fence_first = (pool->fence_first + 1) % GPU_POOL_FRAMES_IN_FLIGHT;
+		  pool->fence_count -= 1;
+	    }
+	    if(pool->fence_count < GPU_POOL_FRAMES_IN_FLIGHT) {
+		  break;
+	    }
+	    GLenum status = glClientWaitSync(pool->fences[pool->fence_first], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); /* 1 second */
+	    if(status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+		  /* e.g. after a device reset the fence may never signal, so the frame is retired anyway rather than waiting forever */
+		  LOG_WARN("GPU pool fence of frame %lld %s, retiring it anyway\n", (long long)pool->fence_frames[pool->fence_first], status == GL_WAIT_FAILED ? "failed" : "timed out");
+		  pool->retired_frame = pool->fence_frames[pool->fence_first];
+		  glDeleteSync(pool->fences[pool->fence_first]);
+		  pool->fence_first = (pool->fence_first + 1) % GPU_POOL_FRAMES_IN_FLIGHT;
+		  pool->fence_count -= 1;
+	    }
+      }
+
+      int slot = (pool->fence_first + pool->fence_count) % GPU_POOL_FRAMES_IN_FLIGHT;
+      pool->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      pool->fence_frames[slot] = pool->frame_index;
+      pool->fence_count += 1;
+
+      pool->frame_index += 1;
+      Gpu_Pool_Evict(pool, pool->budget_bytes, GPU_POOL_MAX_RESOURCES);
+}
+
+
+
+static void Gpu_Pool_Print_Stats(Gpu_Pool* pool)
+{
+      double hit_rate = pool->stats.acquire_count > 0 ? (double)pool->stats.hit_count / (double)pool->stats.acquire_count : 0.0;
+      LOG_INFO("GPU POOL: %lld acquires, %.1f%% hit rate, %.2f MB allocated (%.2f MB peak, %.2f MB budget), %lld evictions (%.2f MB)\n",
+	     (long long)pool->stats.acquire_count,
+	     hit_rate * 100.0,
+	     (double)pool->allocated_bytes / (1024.0 * 1024.0),
+	     (double)pool->stats.peak_bytes / (1024.0 * 1024.0),
+	     (double)pool->budget_bytes / (1024.0 * 1024.0),
+	     (long long)pool->stats.eviction_count,
+	     (double)pool->stats.evicted_bytes / (1024.0 * 1024.0));
+}
+
+
+
+
+/* Returns 1 on success, otherwise 0. Everything is invalidated to begin with so the first frame gets rendered.
+*/
+static int Render_Scheduler_Init(Render_Scheduler* scheduler, int on_demand)
+{
+      memset(scheduler, 0, sizeof(Render_Scheduler));
+      scheduler->on_demand = on_demand;
+      scheduler->invalidation_flags = RENDER_INVALIDATE_REQUEST;
+      scheduler->thread_id = GetCurrentThreadId();
+
+      scheduler->wake_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+      if(scheduler->wake_event == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("CreateEventA() failed to create the render scheduler wake event - win32 error code: %ld\n", win32_error_val);
+	    return 0;
+      }
+
+      LARGE_INTEGER performance_value;
+      QueryPerformanceFrequency(&performance_value);
+      scheduler->counter_frequency = performance_value.QuadPart;
+      QueryPerformanceCounter(&performance_value);
+      scheduler->start_counter = performance_value.QuadPart;
+
+
+      return 1;
+}
+
+
+
+static void Render_Scheduler_Shutdown(Render_Scheduler* scheduler)
+{
+      CloseHandle(scheduler->wake_event);
+      scheduler->wake_event = NULL;
+}
+
+
+
+/* Asks for a frame to be rendered. It can be called from any thread. Only other threads set the wake event: the scheduler's own thread checks the flags before it waits, and a leftover signal on the auto-reset event would wake its next wait for nothing. */
+static void Render_Invalidate(Render_Scheduler* scheduler, LONG flags)
+{
+      InterlockedOr(&scheduler->invalidation_flags, flags);
+      if(scheduler->wake_event != NULL && GetCurrentThreadId() != scheduler->thread_id) {
+	    SetEvent(scheduler->wake_event);
+      }
+}
+
+
+
+/* Asks for a frame to be rendered "seconds" from now, for animations that only need to change every so often (a blinking cursor, a clock) without keeping the scheduler continuous. Timers are one-shot. Returns 0 if all RENDER_SCHEDULER_MAX_TIMERS timers are already pending. Main thread only.
+*/
+static int Render_Schedule_Timer(Render_Scheduler* scheduler, double seconds)
+{
+      LARGE_INTEGER now;
+      QueryPerformanceCounter(&now);
+      LONGLONG due_counter = now.QuadPart + (LONGLONG)(seconds * (double)scheduler->counter_frequency);
+      if(due_counter == 0) {
+	    due_counter = 1;
+      }
+
+      for(int i = 0; i < RENDER_SCHEDULER_MAX_TIMERS; ++i) {
+	    if(scheduler->timer_due_counters[i] == 0) {
+		  scheduler->timer_due_counters[i] = due_counter;
+		  return 1;
+	    }
+      }
+
+
+      return 0;
+}
+
+
+
+/* Invalidates for every timer that has come due, and returns the counts until the next one is due, or -1 if there are no timers pending. */
+static LONGLONG Render_Scheduler_Fire_Timers(Render_Scheduler* scheduler, LONGLONG now_counter)
+{
+      LONGLONG next_due = -1;
+      for(int i = 0; i < RENDER_SCHEDULER_MAX_TIMERS; ++i) {
+	    LONGLONG due_counter = scheduler->timer_due_counters[i];
+	    if(due_counter == 0) {
+		  continue;
+	    }
+	    if(due_counter <= now_counter) {
+		  scheduler->timer_due_counters[i] = 0;
+		  Render_Invalidate(scheduler, RENDER_INVALIDATE_TIMER);
+	    } else if(next_due < 0 || due_counter - now_counter < next_due) {
+		  next_due = due_counter - now_counter;
+	    }
+      }
+
+
+      return next_due;
+}
+
+
+
+/* In on-demand mode, blocks until there is something to render: an invalidation, a message in the queue (which may invalidate once it's dispatched), or a timer coming due. Waits no longer than "max_wait_ms". Returns straight away in continuous mode and while animating, after firing the timers that have come due.
+*/
+static void Render_Scheduler_Wait(Render_Scheduler* scheduler, DWORD max_wait_ms)
+{
+      scheduler->loop_count += 1;
+
+      LARGE_INTEGER start;
+      QueryPerformanceCounter(&start);
+      LONGLONG next_due = Render_Scheduler_Fire_Timers(scheduler, start.QuadPart);
+      if(!scheduler->on_demand || scheduler->animating || scheduler->invalidation_flags != 0) {
+	    return;
+      }
+
+      DWORD timeout_ms = max_wait_ms;
+      if(next_due >= 0) {
+	    LONGLONG due_ms = (next_due * 1000 + scheduler->counter_frequency - 1) / scheduler->counter_frequency; /* rounded up, so we don't wake up just before the timer */
+	    if(due_ms < (LONGLONG)timeout_ms) {
+		  timeout_ms = (DWORD)due_ms;
+	    }
+      }
+
+      /* MWMO_INPUTAVAILABLE also wakes for messages that were already in the queue but not yet removed */
+      MsgWaitForMultipleObjectsEx(1, &scheduler->wake_event, timeout_ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+
+      LARGE_INTEGER end;
+      QueryPerformanceCounter(&end);
+      scheduler->wait_counts += end.QuadPart - start.QuadPart;
+      Render_Scheduler_Fire_Timers(scheduler, end.QuadPart);
+}
+
+
+
+/* Call after the messages have been pumped. Returns 1 if a frame should be rendered, with the invalidations it's for in "invalidation_flags" (and clears them), otherwise 0.
+*/
+static int Render_Scheduler_Begin_Frame(Render_Scheduler* scheduler, LONG* invalidation_flags)
+{
+      LONG flags = InterlockedExchange(&scheduler->invalidation_flags, 0);
+      *invalidation_flags = flags;
+      if(scheduler->on_demand && !scheduler->animating && flags == 0) {
+	    return 0;
+      }
+
+      for(int r = 0; r < RENDER_INVALIDATE_REASON_COUNT; ++r) {
+	    if(flags & (1 << r)) {
+		  scheduler->invalidation_counts[r] += 1;
+	    }
+      }
+      scheduler->frames_rendered += 1;
+
+
+      return 1;
+}
+
+
+
+static void Render_Scheduler_Print_Stats(Render_Scheduler* scheduler)
+{
+      LARGE_INTEGER now;
+      QueryPerformanceCounter(&now);
+      double seconds = (double)(now.QuadPart - scheduler->start_counter) / (double)scheduler->counter_frequency;
+      double idle_percent = seconds > 0.0 ? (double)scheduler->wait_counts / (double)scheduler->counter_frequency / seconds * 100.0 : 0.0;
+      LOG_INFO("RENDER SCHEDULER: %s, %lld frames rendered in %.1f s (%lld loop iterations), %.1f%% idle, invalidations: %lld input, %lld resize, %lld expose, %lld timer, %lld request\n",
+	     scheduler->on_demand ? "on-demand" : "continuous",
+	     (long long)scheduler->frames_rendered,
+	     seconds,
+	     (long long)scheduler->loop_count,
+	     idle_percent,
+	     (long long)scheduler->invalidation_counts[0],
+	     (long long)scheduler->invalidation_counts[1],
+	     (long long)scheduler->invalidation_counts[2],
+	     (long long)scheduler->invalidation_counts[3],
+	     (long long)scheduler->invalidation_counts[4]);
+}
+
+
+
+
+/* every pass declares these, but a pass only sets the uniforms it reads: an unused one is optimized out, and setting an inactive location is GL_INVALID_OPERATION */
+#define PARTICLE_SHADER_HEADER \
+      "#version 460 core\n" \
+      "struct Particle {\n" \
+      "      vec4 position_life; /* w: seconds left to live */\n" \
+      "      vec4 velocity_max_life; /* w: seconds it was born with */\n" \
+      "};\n" \
+      "layout(std430, binding = 0) buffer Source { Particle source_particles[]; };\n" \
+      "layout(std430, binding = 1) buffer Destination { Particle destination_particles[]; };\n" \
+      "layout(std430, binding = 2) buffer Control {\n" \
+      "      uint alive_count[2];\n" \
+      "      uint dispatch_args[3];\n" \
+      "      uint draw_args[4];\n" \
+      "};\n" \
+      "layout(location = 0) uniform uint source_index;\n" \
+      "layout(location = 1) uniform uint max_count;\n" \
+      "const float min_life = " PARTICLE_STRINGIFY(PARTICLE_MIN_LIFE) ";\n" \
+      "const float max_life = " PARTICLE_STRINGIFY(PARTICLE_MAX_LIFE) ";\n"
+
+/* Returns 1 on success, otherwise 0.
+*/
+static int Particle_System_Init(Particle_System* particles, Gpu_Pool* pool, GLuint max_count)
+{
+      memset(particles, 0, sizeof(Particle_System));
+      particles->pool = pool;
+      particles->max_count = max_count;
+      particles->emit_rate = (double)max_count / ((PARTICLE_MIN_LIFE + PARTICLE_MAX_LIFE) * 0.5) * 0.9; /* settles at about 90% of capacity */
+      particles->seed = 0x2545F491u;
+
+      /* emit: appends "emit_count" particles to the source buffer. Appends past the capacity are dropped, and the prepare pass clamps the counter. */
+      const char* emit_source = PARTICLE_SHADER_HEADER
+	    "layout(local_size_x = 256) in;\n"
+	    "layout(location = 2) uniform uint emit_count;\n"
+	    "layout(location = 3) uniform uint seed;\n"
+	    "uint hash(uint x) { x ^= x >> 16; x *= 0x7feb352du; x ^= x >> 15; x *= 0x846ca68bu; x ^= x >> 16; return x; }\n"
+	    "float random(inout uint state) { state = hash(state); return float(state) * (1.0 / 4294967296.0); }\n"
+	    "void main()\n"
+	    "{\n"
+	    "      uint i = gl_GlobalInvocationID.x;\n"
+	    "      if(i >= emit_count) { return; }\n"
+	    "      uint index = atomicAdd(alive_count[source_index], 1u);\n"
+	    "      if(index >= max_count) { return; }\n"
+	    "      uint state = seed ^ (i * 0x9E3779B9u);\n"
+	    "      float life = mix(min_life, max_life, random(state));\n"
+	    "      vec3 velocity = vec3((random(state) - 0.5) * 0.6, 0.8 + random(state) * 0.6, 0.0);\n"
+	    "      source_particles[index].position_life = vec4(0.0, 0.0, 0.0, life);\n"
+	    "      source_particles[index].velocity_max_life = vec4(velocity, life);\n"
+	    "}\n";
+      /* prepare: clamps the source count, turns it into the simulate dispatch, and resets the destination count */
+      const char* prepare_source = PARTICLE_SHADER_HEADER
+	    "layout(local_size_x = 1) in;\n"
+	    "void main()\n"
+	    "{\n"
+	    "      uint count = min(alive_count[source_index], max_count);\n"
+	    "      alive_count[source_index] = count;\n"
+	    "      alive_count[1u - source_index] = 0u;\n"
+	    "      dispatch_args[0] = (count + 255u) / 256u;\n"
+	    "      dispatch_args[1] = 1u;\n"
+	    "      dispatch_args[2] = 1u;\n"
+	    "}\n";
+      /* simulate: integrates every live particle, and compacts the survivors into the destination buffer */
+      const char* simulate_source = PARTICLE_SHADER_HEADER
+	    "layout(local_size_x = 256) in;\n"
+	    "layout(location = 2) uniform float dt;\n"
+	    "void main()\n"
+	    "{\n"
+	    "      uint i = gl_GlobalInvocationID.x;\n"
+	    "      if(i >= alive_count[source_index]) { return; }\n"
+	    "      Particle p = source_particles[i];\n"
+	    "      p.position_life.w -= dt;\n"
+	    "      if(p.position_life.w <= 0.0) { return; }\n"
+	    "      p.velocity_max_life.y -= 1.2 * dt;\n"
+	    "      p.position_life.xyz += p.velocity_max_life.xyz * dt;\n"
+	    "      uint index = atomicAdd(alive_count[1u - source_index], 1u);\n"
+	    "      destination_particles[index] = p;\n"
+	    "}\n";
+      /* finalize: one quad (triangle strip) instance per surviving particle */
+      const char* finalize_source = PARTICLE_SHADER_HEADER
+	    "layout(local_size_x = 1) in;\n"
+	    "void main()\n"
+	    "{\n"
+	    "      draw_args[0] = 4u;\n"
+	    "      draw_args[1] = alive_count[1u - source_index];\n"
+	    "      draw_args[2] = 0u;\n"
+	    "      draw_args[3] = 0u;\n"
+	    "}\n";
+      const char* vert_source = PARTICLE_SHADER_HEADER
+	    "layout(location = 2) uniform float size;\n"
+	    "out vec2 corner;\n"
+	    "out float life_fraction;\n"
+	    "void main()\n"
+	    "{\n"
+	    "      Particle p = destination_particles[gl_InstanceID];\n"
+	    "      corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;\n"
+	    "      life_fraction = p.position_life.w / p.velocity_max_life.w;\n"
+	    "      gl_Position = vec4(p.position_life.xy + corner * size, 0.0, 1.0);\n"
+	    "}\n";
+      const char* frag_source = "#version 460 core\n"
+	    "in vec2 corner;\n"
+	    "in float life_fraction;\n"
+	    "out vec4 frag_color;\n"
+	    "void main()\n"
+	    "{\n"
+	    "      float falloff = max(1.0 - dot(corner, corner), 0.0);\n"
+	    "      frag_color = vec4(1.0, 0.55, 0.2, 1.0) * (falloff * life_fraction * 0.5);\n"
+	    "}\n";
+
+      const GLenum compute_stage = GL_COMPUTE_SHADER;
+      const GLenum render_stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+      const char* render_sources[2] = { vert_source, frag_source };
+      particles->emit_program = Shader_Build_Program(&compute_stage, &emit_source, 1, "particle emit");
+      particles->prepare_program = Shader_Build_Program(&compute_stage, &prepare_source, 1, "particle prepare");
+      particles->simulate_program = Shader_Build_Program(&compute_stage, &simulate_source, 1, "particle simulate");
+      particles->finalize_program = Shader_Build_Program(&compute_stage, &finalize_source, 1, "particle finalize");
+      particles->render_program = Shader_Build_Program(render_stages, render_sources, 2, "particle render");
+      if(particles->emit_program == 0 || particles->prepare_program == 0 || particles->simulate_program == 0 ||
+	 particles->finalize_program == 0 || particles->render_program == 0) {
+	    Particle_System_Shutdown(particles);
+	    return 0;
+      }
+
+      particles->buffer_resources[0] = Gpu_Pool_Acquire_Buffer(pool, (GLsizeiptr)max_count * PARTICLE_SIZE_BYTES);
+      particles->buffer_resources[1] = Gpu_Pool_Acquire_Buffer(pool, (GLsizeiptr)max_count * PARTICLE_SIZE_BYTES);
+      particles->buffer_resources[2] = Gpu_Pool_Acquire_Buffer(pool, PARTICLE_CONTROL_SIZE);
+      if(particles->buffer_resources[0] == NULL || particles->buffer_resources[1] == NULL || particles->buffer_resources[2] == NULL) {
+	    Particle_System_Shutdown(particles);
+	    return 0;
+      }
+      particles->particle_buffers[0] = particles->buffer_resources[0]->name;
+      particles->particle_buffers[1] = particles->buffer_resources[1]->name;
+      particles->control_buffer = particles->buffer_resources[2]->name;
+
+      /* a pooled buffer still holds whatever its last user left in it, so the counters are reset explicitly */
+      GLuint control[PARTICLE_CONTROL_SIZE / 4];
+      memset(control, 0, sizeof(control));
+      glBindBuffer(GL_COPY_WRITE_BUFFER, particles->control_buffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, 0, PARTICLE_CONTROL_SIZE, control);
+      glGenVertexArrays(1, &particles->vao);
+
+
+      return 1;
+}
+
+
+
+static void Particle_System_Shutdown(Particle_System* particles)
+{
+      /* deleting the name 0 is ignored and only acquired buffers are given back, so this also cleans up after a partial Particle_System_Init() */
+      glDeleteProgram(particles->emit_program);
+      glDeleteProgram(particles->prepare_program);
+      glDeleteProgram(particles->simulate_program);
+      glDeleteProgram(particles->finalize_program);
+      glDeleteProgram(particles->render_program);
+      for(int i = 0; i < 3; ++i) {
+	    if(particles->buffer_resources[i] != NULL) {
+		  Gpu_Pool_Release(particles->pool, particles->buffer_resources[i]);
+	    }
+      }
+      glDeleteVertexArrays(1, &particles->vao);
+      memset(particles, 0, sizeof(Particle_System));
+}
+
+
+
+/* Works out the next step of "dt" seconds on the CPU: how many particles it emits and their seed. It makes no GL calls, so it can run in a job, as long as it's not at the same time as Particle_System_Update(). */
+static void Particle_System_Prepare(Particle_System* particles, float dt)
+{
+      if(dt > 0.1f) {
+	    dt = 0.1f; /* e.g. after the window was idle, a long step would just kill every particle at once */
+      }
+
+      particles->emit_accumulator += particles->emit_rate * dt;
+      particles->step_emit_count = (GLuint)particles->emit_accumulator;
+      particles->emit_accumulator -= (double)particles->step_emit_count;
+      particles->seed = particles->seed * 1664525u + 1013904223u;
+      particles->step_dt = dt;
+}
+
+
+
+/* Emits, simulates and compacts the particles for the step set up by Particle_System_Prepare(), entirely on the GPU. */
+static void Particle_System_Update(Particle_System* particles)
+{
+      GLuint emit_count = particles->step_emit_count;
+      float dt = particles->step_dt;
+
+      GLuint source = (GLuint)particles->source;
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles->particle_buffers[source]);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particles->particle_buffers[1 - source]);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particles->control_buffer);
+
+      if(emit_count > 0) {
+	    glUseProgram(particles->emit_program);
+	    glUniform1ui(0, source);
+	    glUniform1ui(1, particles->max_count);
+	    glUniform1ui(2, emit_count);
+	    glUniform1ui(3, particles->seed);
+	    glDispatchCompute((emit_count + PARTICLE_WORK_GROUP_SIZE - 1) / PARTICLE_WORK_GROUP_SIZE, 1, 1);
+	    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      }
+
+      glUseProgram(particles->prepare_program);
+      glUniform1ui(0, source);
+      glUniform1ui(1, particles->max_count);
+      glDispatchCompute(1, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+      glUseProgram(particles->simulate_program);
+      glUniform1ui(0, source);
+      glUniform1f(2, dt);
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, particles->control_buffer);
+      glDispatchComputeIndirect(PARTICLE_CONTROL_DISPATCH_OFFSET);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+      glUseProgram(particles->finalize_program);
+      glUniform1ui(0, source);
+      glDispatchCompute(1, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+      particles->source = 1 - particles->source;
+}
+
+
+
+/* Draws the live particles with additive blending, with the count the last update wrote on the GPU. */
+static void Particle_System_Draw(Particle_System* particles)
+{
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particles->particle_buffers[particles->source]);
+      glUseProgram(particles->render_program);
+      glUniform1f(2, 0.004f);
+      glBindVertexArray(particles->vao);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, particles->control_buffer);
+
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE, GL_ONE);
+      glDrawArraysIndirect(GL_TRIANGLE_STRIP, (const void *)(GLintptr)PARTICLE_CONTROL_DRAW_OFFSET);
+      glDisable(GL_BLEND);
+}
+
+
+
+/* Reads back the number of live particles. This stalls until the GPU has caught up, so it's only for the benchmark and debugging. */
+static GLuint Particle_System_Read_Alive_Count(Particle_System* particles)
+{
+      GLuint alive_count[2];
+      glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+      glGetNamedBufferSubData(particles->control_buffer, 0, sizeof(alive_count), alive_count);
+      return alive_count[particles->source];
+}
+
+
+
+
+/* Returns 1 on success, otherwise 0 if the arrays couldn't be allocated.
+*/
+static int Scene_Init(Scene* scene, int capacity)
+{
+      memset(scene, 0, sizeof(Scene));
+      capacity = (capacity + 63) & ~63; /* whole words of dirty bits */
+      scene->capacity = capacity;
+      scene->translations = (float *)malloc(sizeof(float) * 3 * capacity);
+      scene->rotations = (float *)malloc(sizeof(float) * 4 * capacity);
+      scene->scales = (float *)malloc(sizeof(float) * 3 * capacity);
+      scene->world_matrices = (float *)malloc(sizeof(float) * 16 * capacity);
+      scene->parent_indices = (int *)malloc(sizeof(int) * capacity);
+      scene->subtree_ends = (int *)malloc(sizeof(int) * capacity);
+      scene->dirty_bits = (unsigned long long *)calloc(capacity / 64, sizeof(unsigned long long));
+      scene->draw_vaos = (GLuint *)malloc(sizeof(GLuint) * capacity);
+      scene->draw_counts = (GLsizei *)malloc(sizeof(GLsizei) * capacity);
+      scene->update_ranges = (Scene_Range *)malloc(sizeof(Scene_Range) * capacity);
+      scene->split_ranges = (Scene_Range *)malloc(sizeof(Scene_Range) * capacity);
+      if(scene->translations == NULL || scene->rotations == NULL || scene->scales == NULL || scene->world_matrices == NULL ||
+	 scene->parent_indices == NULL || scene->subtree_ends == NULL || scene->dirty_bits == NULL ||
+	 scene->draw_vaos == NULL || scene->draw_counts == NULL || scene->update_ranges == NULL || scene->split_ranges == NULL) {
+	    Scene_Shutdown(scene);
+	    return 0;
+      }
+
+
+      return 1;
+}
+
+
+
+static void Scene_Shutdown(Scene* scene)
+{
+      free(scene->translations);
+      free(scene->rotations);
+      free(scene->scales);
+      free(scene->world_matrices);
+      free(scene->parent_indices);
+      free(scene->subtree_ends);
+      free(scene->dirty_bits);
+      free(scene->draw_vaos);
+      free(scene->draw_counts);
+      free(scene->update_ranges);
+      free(scene->split_ranges);
+      memset(scene, 0, sizeof(Scene));
+}
+
+
+
+static void Scene_Mark_Dirty(Scene* scene, int node)
+{
+      scene->dirty_bits[node >> 6] |= 1ull << (node & 63);
+}
+
+
+
+/* Adds a node with an identity transform and nothing to draw as the last child of "parent" (or as a new root for SCENE_NO_PARENT), and returns its index, or -1 if the scene is full. The node goes at the end of its parent's subtree, so every node after that moves up by one. Building the scene depth-first only ever appends, which moves nothing.
+*/
+static int Scene_Add_Node(Scene* scene, int parent)
+{
+      if(scene->node_count >= scene->capacity) {
+	    return -1;
+      }
+
+      int node = parent == SCENE_NO_PARENT ? scene->node_count : scene->subtree_ends[parent];
+      int move_count = scene->node_count - node;
+      if(move_count > 0) {
+	    memmove(&scene->translations[(node + 1) * 3], &scene->translations[node * 3], sizeof(float) * 3 * move_count);
+	    memmove(&scene->rotations[(node + 1) * 4], &scene->rotations[node * 4], sizeof(float) * 4 * move_count);
+	    memmove(&scene->scales[(node + 1) * 3], &scene->scales[node * 3], sizeof(float) * 3 * move_count);
+	    memmove(&scene->world_matrices[(node + 1) * 16], &scene->world_matrices[node * 16], sizeof(float) * 16 * move_count);
+	    memmove(&scene->parent_indices[node + 1], &scene->parent_indices[node], sizeof(int) * move_count);
+	    memmove(&scene->subtree_ends[node + 1], &scene->subtree_ends[node], sizeof(int) * move_count);
+	    memmove(&scene->draw_vaos[node + 1], &scene->draw_vaos[node], sizeof(GLuint) * move_count);
+	    memmove(&scene->draw_counts[node + 1], &scene->draw_counts[node], sizeof(GLsizei) * move_count);
+	    for(int i = node + 1; i <= scene->node_count; ++i) {
+		  if(scene->parent_indices[i] >= node) {
+			scene->parent_indices[i] += 1;
+		  }
+		  scene->subtree_ends[i] += 1;
+	    }
+	    /* the dirty bits of the moved nodes would have to move too, marking everything from here on is simpler and inserting is rare */
+	    for(int i = node + 1; i <= scene->node_count; ++i) {
+		  Scene_Mark_Dirty(scene, i);
+	    }
+      }
+      scene->node_count += 1;
+      for(int ancestor = parent; ancestor != SCENE_NO_PARENT; ancestor = scene->parent_indices[ancestor]) {
+	    scene->subtree_ends[ancestor] += 1;
+      }
+
+      float* t = &scene->translations[node * 3];
+      float* r = &scene->rotations[node * 4];
+      float* s = &scene->scales[node * 3];
+      t[0] = 0.0f; t[1] = 0.0f; t[2] = 0.0f;
+      r[0] = 0.0f; r[1] = 0.0f; r[2] = 0.0f; r[3] = 1.0f;
+      s[0] = 1.0f; s[1] = 1.0f; s[2] = 1.0f;
+      scene->parent_indices[node] = parent;
+      scene->subtree_ends[node] = node + 1;
+      scene->draw_vaos[node] = 0;
+      scene->draw_counts[node] = 0;
+      Scene_Mark_Dirty(scene, node);
+
+
+      return node;
+}
+
+
+
+static void Scene_Set_Translation(Scene* scene, int node, float x, float y, float z)
+{
+      float* t = &scene->translations[node * 3];
+      if(t[0] == x && t[1] == y && t[2] == z) {
+	    return;
+      }
+      t[0] = x;
+      t[1] = y;
+      t[2] = z;
+      Scene_Mark_Dirty(scene, node);
+}
+
+
+
+static void Scene_Set_Rotation_Z(Scene* scene, int node, float angle)
+{
+      float* r = &scene->rotations[node * 4];
+      float z = sinf(angle * 0.5f);
+      float w = cosf(angle * 0.5f);
+      if(r[0] == 0.0f && r[1] == 0.0f && r[2] == z && r[3] == w) {
+	    return;
+      }
+      r[0] = 0.0f;
+      r[1] = 0.0f;
+      r[2] = z;
+      r[3] = w;
+      Scene_Mark_Dirty(scene, node);
+}
+
+
+
+static void Scene_Set_Scale(Scene* scene, int node, float x, float y, float z)
+{
+      float* s = &scene->scales[node * 3];
+      if(s[0] == x && s[1] == y && s[2] == z) {
+	    return;
+      }
+      s[0] = x;
+      s[1] = y;
+      s[2] = z;
+      Scene_Mark_Dirty(scene, node);
+}
+
+
+
+/* Same as _BitScanForward64(), which only exists when targeting 64 bits. Elsewhere the word is scanned as two halves. */
+static int Scene_Find_First_Bit(unsigned long* index, unsigned long long mask)
+{
+#if defined(_M_X64) || defined(_M_ARM64)
+      return _BitScanForward64(index, mask) != 0;
+#else
+      if(_BitScanForward(index, (unsigned long)mask)) {
+	    return 1;
+      }
+      if(_BitScanForward(index, (unsigned long)(mask >> 32))) {
+	    *index += 32;
+	    return 1;
+      }
+      return 0;
+#endif
+}
+
+
+
+/* world = parent world * translation * rotation * scale. Every matrix in the scene is affine, so the bottom row is never multiplied out. */
+static void Scene_Compute_World(Scene* scene, int node)
+{
+      const float* t = &scene->translations[node * 3];
+      const float* q = &scene->rotations[node * 4];
+      const float* s = &scene->scales[node * 3];
+
+      float xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+      float xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+      float wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+      float local[16] = {
+	    (1.0f - 2.0f * (yy + zz)) * s[0], 2.0f * (xy + wz) * s[0], 2.0f * (xz - wy) * s[0], 0.0f,
+	    2.0f * (xy - wz) * s[1], (1.0f - 2.0f * (xx + zz)) * s[1], 2.0f * (yz + wx) * s[1], 0.0f,
+	    2.0f * (xz + wy) * s[2], 2.0f * (yz - wx) * s[2], (1.0f - 2.0f * (xx + yy)) * s[2], 0.0f,
+	    t[0], t[1], t[2], 1.0f
+      };
+
+      float* world = &scene->world_matrices[node * 16];
+      int parent = scene->parent_indices[node];
+      if(parent == SCENE_NO_PARENT) {
+	    memcpy(world, local, sizeof(local));
+	    return;
+      }
+
+      const float* p = &scene->world_matrices[parent * 16];
+      for(int column = 0; column < 4; ++column) {
+	    const float* l = &local[column * 4];
+	    world[column * 4 + 0] = p[0] * l[0] + p[4] * l[1] + p[8] * l[2] + p[12] * l[3];
+	    world[column * 4 + 1] = p[1] * l[0] + p[5] * l[1] + p[9] * l[2] + p[13] * l[3];
+	    world[column * 4 + 2] = p[2] * l[0] + p[6] * l[1] + p[10] * l[2] + p[14] * l[3];
+	    world[column * 4 + 3] = l[3];
+      }
+}
+
+
+
+/* Job_Parallel_For() callback, recomputes the world matrices of the ranges [begin, end) in order. */
+static void Scene_Update_Ranges(void* data, int begin, int end)
+{
+      Scene_Update_Batch* batch = (Scene_Update_Batch *)data;
+      for(int r = begin; r < end; ++r) {
+	    for(int i = batch->ranges[r].begin; i < batch->ranges[r].end; ++i) {
+		  Scene_Compute_World(batch->scene, i);
+	    }
+      }
+}
+
+
+
+/* Recomputes the world matrix of every dirty node and all of its descendants, and clears the dirty bits. With a "job_system" (which can be NULL) and enough dirty nodes, the dirty subtrees are updated in parallel.
+*/
+static void Scene_Update_World(Scene* scene, Job_System* job_system)
+{
+      /* collect the dirty subtrees, and clear their dirty bits */
+      int range_count = 0;
+      int dirty_count = 0;
+      int word_count = (scene->node_count + 63) >> 6;
+      for(int word = 0; word < word_count; ++word) {
+	    unsigned long bit;
+	    while(Scene_Find_First_Bit(&bit, scene->dirty_bits[word])) {
+		  int node = (word << 6) + (int)bit;
+		  int end = scene->subtree_ends[node];
+		  scene->update_ranges[range_count].begin = node;
+		  scene->update_ranges[range_count].end = end;
+		  range_count += 1;
+		  dirty_count += end - node;
+
+		  /* clear [node, end), the dirty bits inside the subtree are covered by the range */
+		  int last_word = (end - 1) >> 6;
+		  for(int w = word; w <= last_word; ++w) {
+			unsigned long long mask = ~0ull;
+			if(w == word) {
+			      mask &= ~0ull << bit;
+			}
+			if(w == last_word && (end & 63) != 0) {
+			      mask &= ~(~0ull << (end & 63));
+			}
+			scene->dirty_bits[w] &= ~mask;
+		  }
+		  if(last_word > word) {
+			word = last_word; /* the for loop's increment would skip it, and it may have dirty bits past "end" */
+		  }
+	    }
+      }
+
+      Scene_Update_Batch batch;
+      batch.scene = scene;
+      batch.ranges = scene->update_ranges;
+      if(job_system == NULL || job_system->worker_count == 1 || dirty_count < SCENE_PARALLEL_MIN_NODES) {
+	    Scene_Update_Ranges(&batch, 0, range_count);
+	    return;
+      }
+
+      /* Each dirty subtree only reads the world matrix of its root's parent, which is clean, so the subtrees can all be updated at once. One big subtree (the whole scene when a root moves) would leave the other workers idle though, so big subtrees are split: their root is updated here, after which each child's subtree only depends on it. */
+      Scene_Range* ranges = scene->update_ranges;
+      Scene_Range* split_ranges = scene->split_ranges;
+      int target_count = job_system->worker_count * 4;
+      for(int pass = 0; pass < SCENE_MAX_SPLIT_PASSES && range_count < target_count; ++pass) {
+	    int split_size = dirty_count / target_count;
+	    int split_count = 0;
+	    for(int r = 0; r < range_count; ++r) {
+		  Scene_Range range = ranges[r];
+		  if(range.end - range.begin <= split_size) {
+			split_ranges[split_count++] = range;
+			continue;
+		  }
+
+		  Scene_Compute_World(scene, range.begin);
+		  dirty_count -= 1;
+		  for(int child = range.begin + 1; child < range.end; child = scene->subtree_ends[child]) {
+			split_ranges[split_count].begin = child;
+			split_ranges[split_count].end = scene->subtree_ends[child];
+			split_count += 1;
+		  }
+	    }
+
+	    Scene_Range* swap = ranges;
+	    ranges = split_ranges;
+	    split_ranges = swap;
+	    range_count = split_count;
+      }
+
+      /* this is fork-join when we're called from a job: the worker runs batches itself while it waits for the rest */
+      batch.ranges = ranges;
+      Job_Parallel_For(job_system, range_count, 1, Scene_Update_Ranges, &batch);
+}
+
+
+
+#define SCENE_TEST_INITIAL_NODES 16000
+#define SCENE_TEST_MAX_DEPTH 12
+#define SCENE_TEST_ROUNDS 200
+#define SCENE_TEST_INSERTS_PER_ROUND 2
+
+/* Self test: makes random edits to a random tree, along with inserts into the middle of it, and after each round checks that the incremental Scene_Update_World() left no dirty bits and produced exactly the world matrices of a full recompute in depth-first order. Rounds alternate between the serial update and the job system, and every fourth round edits enough nodes to take the parallel path. Returns 1 if it passed.
+*/
+static int Scene_Test_Incremental(Job_System* job_system)
+{
+      int capacity = SCENE_TEST_INITIAL_NODES + SCENE_TEST_ROUNDS * SCENE_TEST_INSERTS_PER_ROUND;
+      Scene scene;
+      if(Scene_Init(&scene, capacity) != 1) {
+	    LOG_ERROR("SELF TEST: scene_incremental failed to allocate the scene\n");
+	    return 0;
+      }
+      float* incremental_matrices = (float *)malloc(sizeof(float) * 16 * capacity);
+      if(incremental_matrices == NULL) {
+	    LOG_ERROR("SELF TEST: scene_incremental failed to allocate the matrices to compare\n");
+	    Scene_Shutdown(&scene);
+	    return 0;
+      }
+      unsigned int random_state = 0x2545F491u;
+#define SCENE_TEST_RANDOM() (random_state = random_state * 1664525u + 1013904223u, random_state >> 8)
+
+      /* depth-first like the benchmark, so building it only appends */
+      int path[SCENE_TEST_MAX_DEPTH];
+      int path_length = 0;
+      for(int i = 0; i < SCENE_TEST_INITIAL_NODES; ++i) {
+	    path_length = path_length == 0 ? 0 : (int)(SCENE_TEST_RANDOM() % (unsigned int)(path_length + 1));
+	    if(path_length == SCENE_TEST_MAX_DEPTH) {
+		  path_length -= 1;
+	    }
+	    int node = Scene_Add_Node(&scene, path_length == 0 ? SCENE_NO_PARENT : path[path_length - 1]);
+	    Scene_Set_Translation(&scene, node, 0.1f, 0.0f, 0.0f);
+	    Scene_Set_Rotation_Z(&scene, node, (float)(SCENE_TEST_RANDOM() % 6283) * 0.001f);
+	    path[path_length++] = node;
+      }
+      Scene_Update_World(&scene, NULL);
+
+      int failed_round = -1;
+      for(int round = 0; round < SCENE_TEST_ROUNDS && failed_round == -1; ++round) {
+	    /* inserting moves every node after the new one, and marks them all dirty */
+	    for(int i = 0; i < SCENE_TEST_INSERTS_PER_ROUND; ++i) {
+		  int parent = (int)(SCENE_TEST_RANDOM() % (unsigned int)scene.node_count);
+		  int node = Scene_Add_Node(&scene, parent);
+		  Scene_Set_Translation(&scene, node, 0.05f, 0.05f, 0.0f);
+	    }
+
+	    int edit_count = (round & 3) == 3 ? scene.node_count / 2 : (int)(SCENE_TEST_RANDOM() % 64);
+	    for(int i = 0; i < edit_count; ++i) {
+		  int node = (int)(SCENE_TEST_RANDOM() % (unsigned int)scene.node_count);
+		  float value = (float)(SCENE_TEST_RANDOM() % 1000) * 0.001f;
+		  switch(SCENE_TEST_RANDOM() % 3) {
+		  case 0: Scene_Set_Translation(&scene, node, value, -value, 0.0f); break;
+		  case 1: Scene_Set_Rotation_Z(&scene, node, value * 6.283f); break;
+		  case 2: Scene_Set_Scale(&scene, node, 0.5f + value, 1.5f - value, 1.0f); break;
+		  }
+	    }
+
+	    Scene_Update_World(&scene, (round & 1) ? job_system : NULL);
+
+	    for(int w = 0; w < (scene.node_count + 63) >> 6; ++w) {
+		  if(scene.dirty_bits[w] != 0) {
+			LOG_ERROR("SELF TEST: scene_incremental failed, dirty bits left in word %d after round %d\n", w, round);
+			failed_round = round;
+			break;
+		  }
+	    }
+
+	    /* the same arithmetic in the same order, so anything but an exact match is a node that was skipped or updated before its parent */
+	    memcpy(incremental_matrices, scene.world_matrices, sizeof(float) * 16 * scene.node_count);
+	    for(int i = 0; i < scene.node_count; ++i) {
+		  Scene_Compute_World(&scene, i);
+	    }
+	    for(int i = 0; i < scene.node_count && failed_round == -1; ++i) {
+		  if(memcmp(&incremental_matrices[i * 16], &scene.world_matrices[i * 16], sizeof(float) * 16) != 0) {
+			LOG_ERROR("SELF TEST: scene_incremental failed, node %d differs from the full recompute after round %d\n", i, round);
+			failed_round = round;
+		  }
+	    }
+      }
+#undef SCENE_TEST_RANDOM
+
+      int node_count = scene.node_count;
+      free(incremental_matrices);
+      Scene_Shutdown(&scene);
+      if(failed_round != -1) {
+	    return 0;
+      }
+      LOG_INFO("SELF TEST: scene_incremental passed, %d rounds, %d nodes\n", SCENE_TEST_ROUNDS, node_count);
+
+
+      return 1;
+}
+
+
+
+
+/* Makes the main window (and its DC, which the context is current on) window 0 of the set. Call once the context has been made current.
+*/
+static void Window_Set_Init(Window_Set* set, HINSTANCE instance, const char* class_name, HWND main_handle, HDC main_dc, HGLRC context, int pixel_format_id, const PIXELFORMATDESCRIPTOR* pixel_fd, PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT)
+{
+      memset(set, 0, sizeof(Window_Set));
+      set->instance = instance;
+      set->class_name = class_name;
+      set->context = context;
+      set->current_dc = main_dc;
+      set->pixel_format_id = pixel_format_id;
+      set->pixel_fd = *pixel_fd;
+      set->wglSwapIntervalEXT = wglSwapIntervalEXT;
+
+      RECT client_rect;
+      GetClientRect(main_handle, &client_rect);
+      App_Window* window = &set->windows[0];
+      window->handle = main_handle;
+      window->dc = main_dc;
+      window->client_width = client_rect.right - client_rect.left;
+      window->client_height = client_rect.bottom - client_rect.top;
+      window->open = 1;
+      set->window_count = 1;
+}
+
+
+
+/* Opens another window that renders from the shared context, and returns its index, or -1 on failure. Its swaps don't wait for vsync, the main window's swap (which goes last) paces the frame for every window.
+*/
+static int Window_Set_Open(Window_Set* set, const char* name, int width, int height)
+{
+      int index = -1;
+      for(int i = 1; i < set->window_count; ++i) {
+	    if(!set->windows[i].open) {
+		  index = i;
+		  break;
+	    }
+      }
+      if(index < 0) {
+	    if(set->window_count >= WINDOW_SET_MAX_WINDOWS) {
+		  LOG_ERROR("can't open more than %d windows\n", WINDOW_SET_MAX_WINDOWS);
+		  return -1;
+	    }
+	    index = set->window_count;
+      }
+
+      HWND handle = CreateWindowExA
+	    (0,
+	     set->class_name,
+	     name,
+	     WS_OVERLAPPEDWINDOW,
+	     CW_USEDEFAULT,
+	     CW_USEDEFAULT,
+	     width,
+	     height,
+	     NULL,
+	     NULL,
+	     set->instance,
+	     NULL);
+      if(handle == NULL) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("CreateWindowExA() failed to create window - win32 error code: %ld\n", win32_error_val);
+	    return -1;
+      }
+      HDC dc = GetDC(handle);
+      if(dc == NULL) {
+	    LOG_ERROR("GetDC() failed to get DC for window\n");
+	    DestroyWindow(handle);
+	    return -1;
+      }
+      /* the context can only be made current on drawables with the pixel format it was created for */
+      if(SetPixelFormat(dc, set->pixel_format_id, &set->pixel_fd) != TRUE) {
+	    DWORD win32_error_val = GetLastError();
+	    LOG_ERROR("failed to set pixel format with SetPixelFormat() - win32 error code: %ld\n", win32_error_val);
+	    DestroyWindow(handle);
+	    return -1;
+      }
+
+      App_Window* window = &set->windows[index];
+      memset(window, 0, sizeof(App_Window));
+      window->handle = handle;
+      window->dc = dc;
+      window->open = 1;
+      RECT client_rect;
+      GetClientRect(handle, &client_rect);
+      window->client_width = client_rect.right - client_rect.left;
+      window->client_height = client_rect.bottom - client_rect.top;
+      if(index == set->window_count) {
+	    set->window_count += 1;
+      }
+
+      /* the swap interval belongs to the drawable that's current when it's set */
+      if(Window_Set_Bind(set, index) == 1) {
+	    set->wglSwapIntervalEXT(0);
+      }
+      Window_Set_Bind(set, 0);
+      ShowWindow(handle, SW_SHOWNOACTIVATE);
+
+
+      return index;
+}
+
+
+
+/* Closes an extra window. The main window (0) is closed by Window_Set_Shutdown() and the cleanup in Win32_Main(). */
+static void Window_Set_Close(Window_Set* set, int index)
+{
+      App_Window* window = &set->windows[index];
+      if(index == 0 || !window->open) {
+	    return;
+      }
+      if(set->current_dc == window->dc) {
+	    Window_Set_Bind(set, 0);
+      }
+      window->open = 0;
+      DestroyWindow(window->handle); /* CS_OWNDC, the DC goes with the window */
+      window->handle = NULL;
+      window->dc = NULL;
+}
+
+
+
+static void Window_Set_Shutdown(Window_Set* set)
+{
+      for(int i = 1; i < set->window_count; ++i) {
+	    Window_Set_Close(set, i);
+      }
+      LOG_INFO("WINDOWS: %lld drawable switches\n", (long long)set->make_current_count);
+}
+
+
+
+/* Returns the index of the window with "handle", or -1 if it isn't in the set. */
+static int Window_Set_Find(Window_Set* set, HWND handle)
+{
+      for(int i = 0; i < set->window_count; ++i) {
+	    if(set->windows[i].handle == handle) {
+		  return i;
+	    }
+      }
+      return -1;
+}
+
+
+
+/* Points rendering at window "index". The context stays the same, only its drawable changes, and only if it isn't already the current one. Returns 1 on success, otherwise 0.
+*/
+static int Window_Set_Bind(Window_Set* set, int index)
+{
+      App_Window* window = &set->windows[index];
+      if(set->current_dc != window->dc) {
+	    if(wglMakeCurrent(window->dc, set->context) != TRUE) {
+		  DWORD win32_error_val = GetLastError();
+		  LOG_ERROR("wglMakeCurrent() failed to switch to window %d - win32 error code: %ld\n", index, win32_error_val);
+		  return 0;
+	    }
+	    set->current_dc = window->dc;
+	    set->make_current_count += 1;
+      }
+      glViewport(0, 0, window->client_width, window->client_height);
+
+
+      return 1;
+}
+
+
+
+/* Swaps every open window, extra windows first so that only the main window's swap waits for vsync. Swapping doesn't need the window's drawable to be current. */
+static void Window_Set_Swap(Window_Set* set)
+{
+      for(int i = set->window_count - 1; i >= 0; --i) {
+	    if(set->windows[i].open) {
+		  wglSwapLayerBuffers(set->windows[i].dc, WGL_SWAP_MAIN_PLANE);
+	    }
+      }
+}